@@ -3,15 +3,92 @@
 #include "game_state.hpp"
 
 //------------------------------------------------------------------------------
-void RandomPlayer::Think(GameState* state)
+ThinkHandle* AIPlayer::StartThink(const GameState& state)
+{
+  return new ThinkHandle(this, state);
+}
+
+//------------------------------------------------------------------------------
+ThinkHandle::ThinkHandle(AIPlayer* ai, const GameState& gameState)
+    : ai(ai), state(gameState.Snapshot()), startTime(chrono::steady_clock::now())
+{
+  lastStatus = ThinkStatus{ -1, 0, 0, 0, 0, false };
+  ai->stopThinking = 0;
+  thinkThread = thread([this] {
+    size_t numMoves = state->moves.size();
+    this->ai->Think(state);
+    if (state->moves.size() > numMoves)
+      move = state->moves.back();
+    thinkMs = (u32)chrono::duration_cast<chrono::milliseconds>(
+        chrono::steady_clock::now() - startTime).count();
+    AtomicStore(&done, 1);
+  });
+}
+
+//------------------------------------------------------------------------------
+ThinkHandle::~ThinkHandle()
+{
+  Stop();
+  Wait();
+  delete state;
+}
+
+//------------------------------------------------------------------------------
+bool ThinkHandle::Done() const
+{
+  return AtomicLoad(&done) != 0;
+}
+
+//------------------------------------------------------------------------------
+ThinkStatus ThinkHandle::Status()
 {
-  while (true)
+  // keep the last status the AI reported, as it might have nothing to report just as it finishes
+  ThinkStatus status;
+  if (Done())
   {
-    int move = rand() % BOARD_WIDTH;
-    if (state->board.ValidMove(move))
-    {
-      state->board.ApplyMove(move, playerId);
-      return;
-    }
+    lastStatus.bestMove = move;
+    lastStatus.elapsedMs = thinkMs;
+    lastStatus.done = true;
+    return lastStatus;
   }
+
+  if (ai->GetThinkStatus(&status))
+    lastStatus = status;
+  lastStatus.elapsedMs = (u32)chrono::duration_cast<chrono::milliseconds>(
+      chrono::steady_clock::now() - startTime).count();
+  lastStatus.done = false;
+  return lastStatus;
+}
+
+//------------------------------------------------------------------------------
+void ThinkHandle::Stop()
+{
+  // NB: once the think has been waited for, the flag would carry over to the AI's next think, as
+  // nothing is left to clear it
+  if (thinkThread.joinable())
+    AtomicStore(&ai->stopThinking, 1);
+}
+
+//------------------------------------------------------------------------------
+int ThinkHandle::Wait()
+{
+  if (thinkThread.joinable())
+  {
+    thinkThread.join();
+    // don't let a late Stop carry over to the next think
+    ai->stopThinking = 0;
+  }
+  return move;
+}
+
+//------------------------------------------------------------------------------
+void RandomPlayer::Think(GameState* state)
+{
+  u32 validMoves = state->board.validMoves;
+  if (!validMoves)
+    return;
+
+  int move = NthBit64(validMoves, rng.Range(PopCount64(validMoves)));
+  state->board.ApplyMove(move, playerId);
+  state->moves.push_back(move);
 }
@@ -1,6 +1,23 @@
 #pragma once
+#include "atomics.hpp"
+#include "rng.hpp"
 
 struct GameState;
+struct ThinkHandle;
+
+//------------------------------------------------------------------------------
+// Progress of a think that runs in the background
+struct ThinkStatus
+{
+  // the move the AI would play if stopped now, or -1 if it doesn't have one yet
+  int bestMove;
+  // visits for the best move and for the root, for AIs that count them
+  int bestPlayed;
+  int totalPlayed;
+  float bestWinRate;
+  u32 elapsedMs;
+  bool done;
+};
 
 //------------------------------------------------------------------------------
 struct AIPlayer
@@ -8,13 +25,54 @@ struct AIPlayer
   AIPlayer(int playerId) : playerId(playerId) {}
   virtual ~AIPlayer() {};
   virtual void Think(GameState* state) = 0;
+  // Called when the game has ended, so any work in the background can stop
+  virtual void GameOver() {}
+
+  // Starts thinking about the move for the current player of 'state' on another thread, and
+  // returns right away. The think uses its own copy of the state. Only one think can run at a
+  // time, and the handle has to be deleted before the AI is.
+  ThinkHandle* StartThink(const GameState& state);
+  // Fills in the best move so far for a think that's running. Returns false if there isn't
+  // anything to report yet.
+  virtual bool GetThinkStatus(ThinkStatus* /*status*/) { return false; }
 
   int playerId;
+  // Set by ThinkHandle::Stop. AIs that can stop early check it, and play their best move so far.
+  u32 stopThinking = 0;
+};
+
+//------------------------------------------------------------------------------
+// A think running on another thread. Everything here is called from the thread that started it.
+struct ThinkHandle
+{
+  ThinkHandle(AIPlayer* ai, const GameState& state);
+  // stops the think, and waits for it
+  ~ThinkHandle();
+
+  bool Done() const;
+  ThinkStatus Status();
+  // Asks the AI to stop as soon as it can. Wait() then returns the best move found so far. Does
+  // nothing after Wait().
+  void Stop();
+  // Waits for the think to finish, and returns the move it picked, or -1 if there wasn't one
+  int Wait();
+
+  AIPlayer* ai;
+  // the copy of the state that the AI thinks on
+  GameState* state;
+  thread thinkThread;
+  chrono::steady_clock::time_point startTime;
+  ThinkStatus lastStatus;
+  int move = -1;
+  u32 thinkMs = 0;
+  u32 done = 0;
 };
 
 //------------------------------------------------------------------------------
 struct RandomPlayer : public AIPlayer
 {
-  RandomPlayer(int playerId) : AIPlayer(playerId) {}
+  RandomPlayer(int playerId, u64 seed = 0) : AIPlayer(playerId), rng(seed) {}
   virtual void Think(GameState* state);
+
+  Rng rng;
 };
@@ -0,0 +1,90 @@
+#pragma once
+
+//------------------------------------------------------------------------------
+// Atomic operations on plain 32 bit values, and loads and stores of single bytes. The tree is moved
+// around with memmove between searches, so the node fields stay plain ints, and these are used on
+// them while threads share the tree.
+
+//------------------------------------------------------------------------------
+// Adds 'value' to *ptr, and returns the previous value
+inline int AtomicAdd(int* ptr, int value)
+{
+#ifdef _MSC_VER
+  return (int)_InterlockedExchangeAdd((volatile long*)ptr, (long)value);
+#else
+  return __atomic_fetch_add(ptr, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+//------------------------------------------------------------------------------
+// Sets *ptr to 'desired' if it holds 'expected', and returns true if it did
+inline bool AtomicCompareExchange(u32* ptr, u32 expected, u32 desired)
+{
+#ifdef _MSC_VER
+  return (u32)_InterlockedCompareExchange((volatile long*)ptr, (long)desired, (long)expected)
+      == expected;
+#else
+  return __atomic_compare_exchange_n(
+      ptr, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#endif
+}
+
+//------------------------------------------------------------------------------
+// Load with acquire semantics, so writes made before the matching AtomicStore are visible
+inline u32 AtomicLoad(const u32* ptr)
+{
+#ifdef _MSC_VER
+  // x86/x64 loads already have acquire semantics, so this only has to stop the compiler
+  u32 res = *(const volatile u32*)ptr;
+  _ReadWriteBarrier();
+  return res;
+#else
+  return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#endif
+}
+
+//------------------------------------------------------------------------------
+// Store with release semantics
+inline void AtomicStore(u32* ptr, u32 value)
+{
+#ifdef _MSC_VER
+  _ReadWriteBarrier();
+  *(volatile u32*)ptr = value;
+#else
+  __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+#endif
+}
+
+//------------------------------------------------------------------------------
+inline u8 AtomicLoad(const u8* ptr)
+{
+#ifdef _MSC_VER
+  u8 res = *(const volatile u8*)ptr;
+  _ReadWriteBarrier();
+  return res;
+#else
+  return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#endif
+}
+
+//------------------------------------------------------------------------------
+inline void AtomicStore(u8* ptr, u8 value)
+{
+#ifdef _MSC_VER
+  _ReadWriteBarrier();
+  *(volatile u8*)ptr = value;
+#else
+  __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+#endif
+}
+
+//------------------------------------------------------------------------------
+// Sets the bits of 'value' in *ptr, and returns the previous value
+inline u32 AtomicOr(u32* ptr, u32 value)
+{
+#ifdef _MSC_VER
+  return (u32)_InterlockedOr((volatile long*)ptr, (long)value);
+#else
+  return __atomic_fetch_or(ptr, value, __ATOMIC_SEQ_CST);
+#endif
+}
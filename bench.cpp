@@ -0,0 +1,87 @@
+#include "bench.hpp"
+#include "game_state.hpp"
+#include "mcts.hpp"
+
+// Positions to search, as the columns played from an empty board. Player 1 starts.
+static const vector<vector<int>> BENCH_POSITIONS = {
+    {},
+    {9, 10, 10, 9, 8, 11, 9, 10},
+    {9, 10, 10, 9, 8, 11, 9, 10, 7, 12, 12, 8, 11, 11, 6, 13, 10, 5, 9, 9, 4, 14, 13, 12},
+};
+
+//------------------------------------------------------------------------------
+struct BenchResult
+{
+  double iterationsPerSecond;
+  double selectionNsPerLevel;
+};
+
+//------------------------------------------------------------------------------
+static BenchResult Measure(ParallelMode mode, int numThreads)
+{
+  u64 iterations = 0;
+  u64 thinkMs = 0;
+  u64 selectionLevels = 0;
+  u64 selectionNs = 0;
+  for (const vector<int>& moves : BENCH_POSITIONS)
+  {
+    GameState state({new Player{1}, new Player{2}});
+    int player = 1;
+    for (int move : moves)
+    {
+      state.board.ApplyMove(move, player);
+      state.moves.push_back(move);
+      player = 1 + player % 2;
+    }
+
+    MCTSConfig config;
+    config.numThreads = numThreads;
+    config.parallelMode = mode;
+    config.verbose = false;
+    config.profileSelection = true;
+    MCTS mcts(player, config);
+    mcts.Think(&state);
+
+    iterations += mcts.iterations;
+    thinkMs += mcts.thinkMs;
+    selectionLevels += mcts.selectionLevels;
+    selectionNs += mcts.selectionNs;
+  }
+
+  return BenchResult{iterations * 1000.0 / max<u64>(1, thinkMs),
+      (double)selectionNs / max<u64>(1, selectionLevels)};
+}
+
+//------------------------------------------------------------------------------
+void RunScalingBenchmark(int maxThreads)
+{
+  maxThreads = max(1, maxThreads);
+  vector<int> threadCounts;
+  for (int i = 1; i < maxThreads; i *= 2)
+    threadCounts.push_back(i);
+  threadCounts.push_back(maxThreads);
+
+  printf("%d positions\n", (int)BENCH_POSITIONS.size());
+  printf("threads    root it/s  speedup  ns/level    tree it/s  speedup  ns/level\n");
+
+  BenchResult rootBase{}, treeBase{};
+  for (int numThreads : threadCounts)
+  {
+    BenchResult root = Measure(PARALLEL_ROOT, numThreads);
+    BenchResult tree = Measure(PARALLEL_TREE, numThreads);
+    if (numThreads == 1)
+    {
+      rootBase = root;
+      treeBase = tree;
+    }
+
+    printf("%7d %12.0f %8.2f %9.1f %12.0f %8.2f %9.1f\n",
+        numThreads,
+        root.iterationsPerSecond,
+        root.iterationsPerSecond / rootBase.iterationsPerSecond,
+        root.selectionNsPerLevel,
+        tree.iterationsPerSecond,
+        tree.iterationsPerSecond / treeBase.iterationsPerSecond,
+        tree.selectionNsPerLevel);
+  }
+}
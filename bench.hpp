@@ -0,0 +1,7 @@
+#pragma once
+
+//------------------------------------------------------------------------------
+// Searches a few fixed positions with 1 to maxThreads threads, for both root and tree
+// parallelism, and prints the iterations/s, the speedup over a single thread, and the selection
+// cost per tree level
+void RunScalingBenchmark(int maxThreads);
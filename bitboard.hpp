@@ -0,0 +1,140 @@
+#pragma once
+
+//------------------------------------------------------------------------------
+inline int PopCount64(u64 v)
+{
+#ifdef _MSC_VER
+  return (int)__popcnt64(v);
+#else
+  return __builtin_popcountll(v);
+#endif
+}
+
+//------------------------------------------------------------------------------
+inline int LowestBit64(u64 v)
+{
+#ifdef _MSC_VER
+  unsigned long idx;
+  _BitScanForward64(&idx, v);
+  return (int)idx;
+#else
+  return __builtin_ctzll(v);
+#endif
+}
+
+//------------------------------------------------------------------------------
+// Returns the index of the n'th (0 based) set bit in mask
+inline int NthBit64(u64 mask, int n)
+{
+  while (n--)
+    mask &= mask - 1;
+  return LowestBit64(mask);
+}
+
+//------------------------------------------------------------------------------
+// Fixed size set of 256 bits, with the shift/and operations needed for line detection
+struct BitBoard
+{
+  enum
+  {
+    NUM_WORDS = 4,
+    NUM_BITS = NUM_WORDS * 64,
+  };
+
+  BitBoard() { Clear(); }
+
+  void Clear()
+  {
+    for (int i = 0; i < NUM_WORDS; ++i)
+      words[i] = 0;
+  }
+
+  bool Test(int bit) const { return ((words[bit >> 6] >> (bit & 63)) & 1) != 0; }
+  void Set(int bit) { words[bit >> 6] |= 1ull << (bit & 63); }
+  void Reset(int bit) { words[bit >> 6] &= ~(1ull << (bit & 63)); }
+
+  bool Any() const { return (words[0] | words[1] | words[2] | words[3]) != 0; }
+
+  int PopCount() const
+  {
+    int res = 0;
+    for (int i = 0; i < NUM_WORDS; ++i)
+      res += PopCount64(words[i]);
+    return res;
+  }
+
+  // Returns the index of the lowest set bit, or -1 if no bits are set
+  int FirstBit() const
+  {
+    for (int i = 0; i < NUM_WORDS; ++i)
+    {
+      if (words[i])
+        return i * 64 + LowestBit64(words[i]);
+    }
+    return -1;
+  }
+
+  BitBoard operator&(const BitBoard& rhs) const
+  {
+    BitBoard res;
+    for (int i = 0; i < NUM_WORDS; ++i)
+      res.words[i] = words[i] & rhs.words[i];
+    return res;
+  }
+
+  BitBoard operator|(const BitBoard& rhs) const
+  {
+    BitBoard res;
+    for (int i = 0; i < NUM_WORDS; ++i)
+      res.words[i] = words[i] | rhs.words[i];
+    return res;
+  }
+
+  BitBoard& operator&=(const BitBoard& rhs)
+  {
+    for (int i = 0; i < NUM_WORDS; ++i)
+      words[i] &= rhs.words[i];
+    return *this;
+  }
+
+  BitBoard& operator|=(const BitBoard& rhs)
+  {
+    for (int i = 0; i < NUM_WORDS; ++i)
+      words[i] |= rhs.words[i];
+    return *this;
+  }
+
+  // Moves every bit n places towards bit 0, so bit i of the result is bit (i + n) of the input
+  BitBoard ShiftDown(int n) const
+  {
+    BitBoard res;
+    int wordOfs = n >> 6;
+    int bitOfs = n & 63;
+    for (int i = 0; i < NUM_WORDS; ++i)
+    {
+      int src = i + wordOfs;
+      u64 lo = src < NUM_WORDS ? words[src] : 0;
+      u64 hi = src + 1 < NUM_WORDS ? words[src + 1] : 0;
+      res.words[i] = bitOfs ? (lo >> bitOfs) | (hi << (64 - bitOfs)) : lo;
+    }
+    return res;
+  }
+
+  // Moves every bit n places away from bit 0, so bit i of the result is bit (i - n) of the input
+  BitBoard ShiftUp(int n) const
+  {
+    BitBoard res;
+    int wordOfs = n >> 6;
+    int bitOfs = n & 63;
+    for (int i = 0; i < NUM_WORDS; ++i)
+    {
+      int src = i - wordOfs;
+      u64 hi = src >= 0 ? words[src] : 0;
+      u64 lo = src - 1 >= 0 ? words[src - 1] : 0;
+      res.words[i] = bitOfs ? (hi << bitOfs) | (lo >> (64 - bitOfs)) : hi;
+    }
+    return res;
+  }
+
+  u64 words[NUM_WORDS];
+};
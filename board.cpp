@@ -1,15 +1,75 @@
 #include "board.hpp"
 #include "game_state.hpp"
+#include "line_windows.hpp"
+#include "rng.hpp"
 
 extern SDL_Window* g_window;
 extern SDL_Renderer* g_renderer;
 
 static const char UNUSED_CELL = 0;
 
+// a random key for each player and cell, which are xored together to give the board hash
+static u64 ZOBRIST_KEYS[MAX_PLAYERS][BitBoard::NUM_BITS];
+
+//------------------------------------------------------------------------------
+static struct InitZobristKeys
+{
+  InitZobristKeys()
+  {
+    // fixed seed, so hashes are the same from run to run
+    Rng rng(0x5eed);
+    for (int i = 0; i < MAX_PLAYERS; ++i)
+    {
+      for (int j = 0; j < BitBoard::NUM_BITS; ++j)
+        ZOBRIST_KEYS[i][j] = rng.Next();
+    }
+  }
+} initZobristKeys;
+
+//------------------------------------------------------------------------------
+// Returns a mask with a bit set for each cell that starts a line of WIN_LENGTH pieces going in
+// the direction of 'shift'. Each step doubles the length of the lines found, so this only needs
+// log2(WIN_LENGTH) + 1 shifts.
+static BitBoard LineStarts(const BitBoard& pieces, int shift)
+{
+  BitBoard lines = pieces;
+  int len = 1;
+  while (len * 2 <= WIN_LENGTH)
+  {
+    lines &= lines.ShiftDown(len * shift);
+    len *= 2;
+  }
+
+  if (len < WIN_LENGTH)
+    lines &= lines.ShiftDown((WIN_LENGTH - len) * shift);
+
+  return lines;
+}
+
 //------------------------------------------------------------------------------
 Board::Board()
 {
-  memset(state, UNUSED_CELL, sizeof(state));
+  for (int i = 0; i < MAX_PLAYERS; ++i)
+    pieces[i].Clear();
+  memset(heights, 0, sizeof(heights));
+  numMoves = 0;
+  validMoves = (1u << BOARD_WIDTH) - 1;
+  hash = 0;
+}
+
+//------------------------------------------------------------------------------
+int Board::CellBit(int row, int col)
+{
+  return col * COLUMN_STRIDE + (BOARD_HEIGHT - 1 - row);
+}
+
+//------------------------------------------------------------------------------
+BitBoard Board::Occupied() const
+{
+  BitBoard res = pieces[0];
+  for (int i = 1; i < MAX_PLAYERS; ++i)
+    res |= pieces[i];
+  return res;
 }
 
 //------------------------------------------------------------------------------
@@ -21,7 +81,7 @@ bool Board::InsideBoard(int row, int col) const
 //------------------------------------------------------------------------------
 bool Board::ValidMove(int col) const
 {
-  return EmptySlot(0, col);
+  return col >= 0 && col < BOARD_WIDTH && heights[col] < BOARD_HEIGHT;
 }
 
 //------------------------------------------------------------------------------
@@ -50,28 +110,88 @@ bool Board::ApplyMove(int col, char player)
   if (!ValidMove(col))
     return false;
 
-  // determine how far the piece will fall
-  int row = 0;
-  while (EmptySlot(row + 1, col))
+  int bit = col * COLUMN_STRIDE + heights[col];
+  pieces[player - 1].Set(bit);
+  hash ^= ZOBRIST_KEYS[player - 1][bit];
+  heights[col]++;
+  numMoves++;
+  if (heights[col] == BOARD_HEIGHT)
+    validMoves &= ~(1u << col);
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+MoveResult Board::ApplyMoveCheckWin(int col, char player)
+{
+  if (!ValidMove(col))
+    return MoveResult{-1, col, false};
+
+  int bit = col * COLUMN_STRIDE + heights[col];
+  int row = BOARD_HEIGHT - 1 - heights[col];
+  ApplyMove(col, player);
+
+  // only the lines going through the new piece can have been completed
+  return MoveResult{row, col, CompletesLine(bit, player)};
+}
+
+//------------------------------------------------------------------------------
+void Board::UndoMove(int col)
+{
+  // remove the top piece of the column, whoever it belongs to
+  heights[col]--;
+  int bit = col * COLUMN_STRIDE + heights[col];
+  for (int i = 0; i < MAX_PLAYERS; ++i)
   {
-    row += 1;
+    if (pieces[i].Test(bit))
+    {
+      hash ^= ZOBRIST_KEYS[i][bit];
+      pieces[i].Reset(bit);
+    }
   }
 
-  At(row, col) = player;
-
-  return true;
+  numMoves--;
+  validMoves |= 1u << col;
 }
 
 //------------------------------------------------------------------------------
-char& Board::At(int row, int col)
+bool Board::CompletesLine(int bit, char player) const
 {
-  return state[row * BOARD_WIDTH + col];
+  const BitBoard& own = pieces[player - 1];
+  for (const LineDirection& dir : LINE_DIRECTIONS)
+  {
+    // count the pieces on both sides of the cell. The padding bits stop the walk at the column
+    // edges, so only the start/end of the whole bitboard needs checking
+    int len = 1;
+    for (int cur = bit + dir.shift; len < WIN_LENGTH && cur < BitBoard::NUM_BITS && own.Test(cur);
+         cur += dir.shift)
+    {
+      len++;
+    }
+
+    for (int cur = bit - dir.shift; len < WIN_LENGTH && cur >= 0 && own.Test(cur);
+         cur -= dir.shift)
+    {
+      len++;
+    }
+
+    if (len >= WIN_LENGTH)
+      return true;
+  }
+
+  return false;
 }
 
 //------------------------------------------------------------------------------
 char Board::At(int row, int col) const
 {
-  return state[row * BOARD_WIDTH + col];
+  int bit = CellBit(row, col);
+  for (int i = 0; i < MAX_PLAYERS; ++i)
+  {
+    if (pieces[i].Test(bit))
+      return (char)(i + 1);
+  }
+  return UNUSED_CELL;
 }
 
 //------------------------------------------------------------------------------
@@ -95,28 +215,41 @@ int Board::LongestLine(int row, int col, int dirX, int dirY) const
 //------------------------------------------------------------------------------
 bool Board::IsBoardFull() const
 {
-  for (int i = 0; i < BOARD_HEIGHT * BOARD_WIDTH; ++i)
+  return numMoves == BOARD_WIDTH * BOARD_HEIGHT;
+}
+
+//------------------------------------------------------------------------------
+u64 Board::ComputeHash() const
+{
+  u64 res = 0;
+  for (int i = 0; i < MAX_PLAYERS; ++i)
   {
-    if (state[i] == UNUSED_CELL)
-      return false;
+    for (int bit = 0; bit < BitBoard::NUM_BITS; ++bit)
+    {
+      if (pieces[i].Test(bit))
+        res ^= ZOBRIST_KEYS[i][bit];
+    }
   }
-  return true;
+  return res;
 }
 
 //------------------------------------------------------------------------------
 WinningMove Board::Winner() const
 {
-  for (int i = 0; i < BOARD_HEIGHT; ++i)
+  for (int i = 0; i < MAX_PLAYERS; ++i)
   {
-    for (int j = 0; j < BOARD_WIDTH; ++j)
+    if (!pieces[i].Any())
+      continue;
+
+    for (const LineDirection& dir : LINE_DIRECTIONS)
     {
-      int dir[] = {0, 1, 1, 0, 1, 1, -1, 1};
-      for (int n = 0; n < 4; ++n)
+      int bit = LineStarts(pieces[i], dir.shift).FirstBit();
+      if (bit != -1)
       {
-        if (LongestLine(i, j, dir[n * 2 + 0], dir[n * 2 + 1]) >= WIN_LENGTH)
-        {
-          return WinningMove{At(i, j), j, i, dir[n * 2 + 0], dir[n * 2 + 1]};
-        }
+        int col = bit / COLUMN_STRIDE;
+        int row = BOARD_HEIGHT - 1 - bit % COLUMN_STRIDE;
+        // rows count down from the top here, the opposite of LINE_DIRECTIONS
+        return WinningMove{i + 1, col, row, dir.dirX, -dir.dirY};
       }
     }
   }
@@ -1,4 +1,5 @@
 #pragma once
+#include "bitboard.hpp"
 #include "game_types.hpp"
 
 //------------------------------------------------------------------------------
@@ -7,6 +8,21 @@ enum
   BOARD_WIDTH = 20,
   BOARD_HEIGHT = 10,
   WIN_LENGTH = 5,
+  MAX_PLAYERS = 4,
+  // each column is stored bottom-up in COLUMN_STRIDE bits. The extra bit at the top of each
+  // column is always clear, so lines can't wrap into the next column when shifting.
+  COLUMN_STRIDE = BOARD_HEIGHT + 1,
+};
+
+static_assert(BOARD_WIDTH * COLUMN_STRIDE <= BitBoard::NUM_BITS, "Board doesn't fit in a BitBoard");
+static_assert(BOARD_WIDTH <= 32, "Valid moves don't fit in a u32");
+
+//------------------------------------------------------------------------------
+// The cell a dropped piece landed in, and if it completed a line. row is -1 if the column was full.
+struct MoveResult
+{
+  int row, col;
+  bool won;
 };
 
 //------------------------------------------------------------------------------
@@ -20,11 +36,28 @@ struct Board
   bool EmptySlot(int row, int col) const;
 
   bool ApplyMove(int col, char player);
-  char& At(int row, int col);
+  MoveResult ApplyMoveCheckWin(int col, char player);
+  void UndoMove(int col);
   char At(int row, int col) const;
   int LongestLine(int row, int col, int dirX, int dirY) const;
   WinningMove Winner() const;
   bool IsBoardFull() const;
+  // Computes the hash from scratch. It's kept up to date by the moves, so this is only needed to
+  // check it.
+  u64 ComputeHash() const;
+
+  static int CellBit(int row, int col);
+  BitBoard Occupied() const;
+  bool CompletesLine(int bit, char player) const;
 
-  char state[BOARD_HEIGHT * BOARD_WIDTH];
+  // one bitmask per player, indexed by player id - 1
+  BitBoard pieces[MAX_PLAYERS];
+  // number of pieces in each column
+  u8 heights[BOARD_WIDTH];
+  int numMoves;
+  // bit n is set if column n isn't full
+  u32 validMoves;
+  // Zobrist hash of the pieces, updated by ApplyMove and UndoMove. The same position has the same
+  // hash whichever order the moves were played in.
+  u64 hash;
 };
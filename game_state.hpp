@@ -24,6 +24,23 @@ struct GameState
       delete p;
   }
   GameState(const vector<Player*>& players) : players(players) { winningMove.player = NO_WINNER; }
+
+  // Returns a copy of the board and moves, for thinking on another thread. The players in the copy
+  // don't have AIs, as they are owned by this state.
+  GameState* Snapshot() const
+  {
+    vector<Player*> copies;
+    for (const Player* p : players.data)
+      copies.push_back(new Player{ p->id, nullptr });
+
+    GameState* res = new GameState(copies);
+    res->board = board;
+    res->winningMove = winningMove;
+    res->players.idx = players.idx;
+    res->moves = moves;
+    return res;
+  }
+
   Board board;
 
   WinningMove winningMove;
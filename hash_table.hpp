@@ -0,0 +1,114 @@
+#pragma once
+
+//------------------------------------------------------------------------------
+// Open addressing hash table keyed on 64 bit hashes, like Board::hash, for the caches used by the
+// searches. Linear probing in a fixed size table, so a lookup is a few reads from neighbouring
+// entries. NB: this isn't thread safe, see TranspositionTable for the table the MCTS threads share.
+template <typename T>
+struct HashTable
+{
+  enum
+  {
+    // entries looked at before giving up on a find or insert
+    MAX_PROBES = 8,
+  };
+
+  struct Entry
+  {
+    u64 key;
+    T value;
+    bool used;
+  };
+
+  // 'numBits' is log2 of the number of entries
+  void Init(int numBits)
+  {
+    entries.assign((size_t)1 << numBits, Entry());
+    mask = (u32)(entries.size() - 1);
+    numUsed = 0;
+  }
+
+  void Clear()
+  {
+    if (numUsed == 0)
+      return;
+
+    for (Entry& entry : entries)
+      entry.used = false;
+    numUsed = 0;
+  }
+
+  // Returns the value for 'key', or nullptr
+  T* Find(u64 key)
+  {
+    for (u32 i = 0; i < MAX_PROBES; ++i)
+    {
+      Entry& entry = entries[((u32)key + i) & mask];
+      if (!entry.used)
+        return nullptr;
+      if (entry.key == key)
+        return &entry.value;
+    }
+
+    return nullptr;
+  }
+
+  // Returns the value for 'key', adding a default constructed one if it's not in the table.
+  // Returns nullptr if the entries it could go in are all in use.
+  T* Insert(u64 key)
+  {
+    for (u32 i = 0; i < MAX_PROBES; ++i)
+    {
+      Entry& entry = entries[((u32)key + i) & mask];
+      if (!entry.used)
+      {
+        entry.key = key;
+        entry.value = T();
+        entry.used = true;
+        numUsed++;
+        return &entry.value;
+      }
+
+      if (entry.key == key)
+        return &entry.value;
+    }
+
+    return nullptr;
+  }
+
+  // Like Insert, but if the entries 'key' can go in are all in use, the one with the lowest value
+  // by 'less' is replaced. The returned value is then default constructed.
+  template <typename Less>
+  T* InsertOrReplace(u64 key, Less less)
+  {
+    Entry* worst = nullptr;
+    for (u32 i = 0; i < MAX_PROBES; ++i)
+    {
+      Entry& entry = entries[((u32)key + i) & mask];
+      if (!entry.used)
+      {
+        entry.key = key;
+        entry.value = T();
+        entry.used = true;
+        numUsed++;
+        return &entry.value;
+      }
+
+      if (entry.key == key)
+        return &entry.value;
+
+      if (!worst || less(entry.value, worst->value))
+        worst = &entry;
+    }
+
+    worst->key = key;
+    worst->value = T();
+    return &worst->value;
+  }
+
+  size_t Size() const { return numUsed; }
+
+  vector<Entry> entries;
+  u32 mask = 0;
+  size_t numUsed = 0;
+};
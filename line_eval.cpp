@@ -0,0 +1,109 @@
+#include "line_eval.hpp"
+#include "line_windows.hpp"
+
+enum
+{
+  THREE_SCORE = 1,
+  FOUR_SCORE = 4,
+};
+
+//------------------------------------------------------------------------------
+// Window counters for one player, with the count of their pieces in each window as a bit sliced
+// number, and the windows that someone else has pieces in
+struct WindowCounts
+{
+  BitBoard ones, twos, fours;
+  BitBoard blocked;
+
+  // adds cell k of every window, where 'own' and 'occupied' have been shifted by k steps
+  void Add(const BitBoard& own, const BitBoard& occupied)
+  {
+    for (int w = 0; w < BitBoard::NUM_WORDS; ++w)
+    {
+      u64 carry = ones.words[w] & own.words[w];
+      ones.words[w] ^= own.words[w];
+      u64 carry2 = twos.words[w] & carry;
+      twos.words[w] ^= carry;
+      fours.words[w] |= carry2;
+      blocked.words[w] |= occupied.words[w] & ~own.words[w];
+    }
+  }
+};
+
+//------------------------------------------------------------------------------
+// Adds each player's score for the windows going in direction DIR of LINE_DIRECTIONS, which has
+// a shift of SHIFT. The shifts are compile time constants, so the BitBoard shifts compile down to
+// a few instructions each.
+template <int DIR, int SHIFT>
+static void ScoreDirection(
+    const BitBoard* pieces, int numPlayers, const BitBoard& occupied, int scores[MAX_PLAYERS])
+{
+  static_assert(WIN_LENGTH == 5, "ScoreDirection assumes 5 in a row");
+
+  // the occupied cells shifted by each step along the line, so bit s of occupied<k> is cell k of
+  // the window starting at s. NB: the steps are spelled out, so they stay constants.
+  BitBoard occupied1 = occupied.ShiftDown(SHIFT);
+  BitBoard occupied2 = occupied.ShiftDown(2 * SHIFT);
+  BitBoard occupied3 = occupied.ShiftDown(3 * SHIFT);
+  BitBoard occupied4 = occupied.ShiftDown(4 * SHIFT);
+
+  for (int p = 0; p < numPlayers; ++p)
+  {
+    const BitBoard& own = pieces[p];
+    WindowCounts counts;
+    counts.Add(own, occupied);
+    counts.Add(own.ShiftDown(SHIFT), occupied1);
+    counts.Add(own.ShiftDown(2 * SHIFT), occupied2);
+    counts.Add(own.ShiftDown(3 * SHIFT), occupied3);
+    counts.Add(own.ShiftDown(4 * SHIFT), occupied4);
+
+    int numThrees = 0, numFours = 0;
+    for (int w = 0; w < BitBoard::NUM_WORDS; ++w)
+    {
+      u64 ones = counts.ones.words[w], twos = counts.twos.words[w], fours = counts.fours.words[w];
+      u64 open = WINDOW_STARTS[DIR].words[w] & ~counts.blocked.words[w];
+      numThrees += PopCount64(open & ~fours & twos & ones);
+      numFours += PopCount64(open & fours & ~twos & ~ones);
+    }
+    scores[p] += THREE_SCORE * numThrees + FOUR_SCORE * numFours;
+  }
+}
+
+//------------------------------------------------------------------------------
+void EvaluateLines(const BitBoard* pieces, int numPlayers, float shares[MAX_PLAYERS + 1])
+{
+  BitBoard occupied;
+  for (int p = 0; p < numPlayers; ++p)
+    occupied |= pieces[p];
+
+  int scores[MAX_PLAYERS] = {0};
+  ScoreDirection<0, 1>(pieces, numPlayers, occupied, scores);
+  ScoreDirection<1, COLUMN_STRIDE>(pieces, numPlayers, occupied, scores);
+  ScoreDirection<2, COLUMN_STRIDE + 1>(pieces, numPlayers, occupied, scores);
+  ScoreDirection<3, COLUMN_STRIDE - 1>(pieces, numPlayers, occupied, scores);
+
+  // everyone starts at 1, so a board without any threes is an even split
+  int total = 0;
+  for (int p = 0; p < numPlayers; ++p)
+    total += 1 + scores[p];
+
+  shares[NO_WINNER] = 0;
+  for (int p = 0; p < MAX_PLAYERS; ++p)
+    shares[p + 1] = p < numPlayers ? (1 + scores[p]) / (float)total : 0;
+}
+
+//------------------------------------------------------------------------------
+int PickLikelyWinner(const BitBoard* pieces, int numPlayers, Rng& rng)
+{
+  float shares[MAX_PLAYERS + 1];
+  EvaluateLines(pieces, numPlayers, shares);
+
+  float x = rng.Range(1 << 16) / (float)(1 << 16);
+  for (int p = 1; p < numPlayers; ++p)
+  {
+    x -= shares[p];
+    if (x < 0)
+      return p;
+  }
+  return numPlayers;
+}
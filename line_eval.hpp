@@ -0,0 +1,16 @@
+#pragma once
+#include "board.hpp"
+#include "rng.hpp"
+
+//------------------------------------------------------------------------------
+// Static evaluation for playouts that are stopped before the end of the game. Each player scores
+// for the windows of WIN_LENGTH cells that they have 3 or 4 pieces in, and no one else has any
+// pieces in. These are counted for the whole board at once with bitboard shifts, along each line
+// direction.
+
+// Sets shares[p] to player p's share of the total score. The shares add up to 1.
+void EvaluateLines(const BitBoard* pieces, int numPlayers, float shares[MAX_PLAYERS + 1]);
+
+// Picks a player at random, weighted by the shares from EvaluateLines. A playout that's cut short
+// still gets a whole win this way, which averages out to the shares over many playouts.
+int PickLikelyWinner(const BitBoard* pieces, int numPlayers, Rng& rng);
@@ -0,0 +1,46 @@
+#include "line_windows.hpp"
+
+const LineDirection LINE_DIRECTIONS[NUM_LINE_DIRECTIONS] = {
+    {1, 0, 1},
+    {COLUMN_STRIDE, 1, 0},
+    {COLUMN_STRIDE + 1, 1, 1},
+    {COLUMN_STRIDE - 1, 1, -1},
+};
+
+int NUM_WINDOWS;
+int WINDOW_CELLS[MAX_WINDOWS][WIN_LENGTH];
+int CELL_WINDOWS[BitBoard::NUM_BITS][MAX_CELL_WINDOWS];
+int CELL_NUM_WINDOWS[BitBoard::NUM_BITS];
+BitBoard WINDOW_STARTS[NUM_LINE_DIRECTIONS];
+
+//------------------------------------------------------------------------------
+static struct InitWindows
+{
+  InitWindows()
+  {
+    for (int d = 0; d < NUM_LINE_DIRECTIONS; ++d)
+    {
+      const LineDirection& dir = LINE_DIRECTIONS[d];
+      for (int col = 0; col < BOARD_WIDTH; ++col)
+      {
+        for (int row = 0; row < BOARD_HEIGHT; ++row)
+        {
+          int endCol = col + dir.dirX * (WIN_LENGTH - 1);
+          int endRow = row + dir.dirY * (WIN_LENGTH - 1);
+          if (endCol >= BOARD_WIDTH || endRow < 0 || endRow >= BOARD_HEIGHT)
+            continue;
+
+          int start = col * COLUMN_STRIDE + row;
+          WINDOW_STARTS[d].Set(start);
+          for (int i = 0; i < WIN_LENGTH; ++i)
+          {
+            int bit = start + dir.shift * i;
+            WINDOW_CELLS[NUM_WINDOWS][i] = bit;
+            CELL_WINDOWS[bit][CELL_NUM_WINDOWS[bit]++] = NUM_WINDOWS;
+          }
+          NUM_WINDOWS++;
+        }
+      }
+    }
+  }
+} initWindows;
@@ -0,0 +1,38 @@
+#pragma once
+#include "board.hpp"
+
+//------------------------------------------------------------------------------
+// A line direction, as the shift between neighbouring cells, and the matching step in columns and
+// rows. Board bits go up the columns, so a shift of 1 is one row up, and dirY counts rows from the
+// bottom. NB: Board::CellBit rows count from the top.
+struct LineDirection
+{
+  int shift;
+  int dirX, dirY;
+};
+
+enum
+{
+  NUM_LINE_DIRECTIONS = 4,
+};
+
+extern const LineDirection LINE_DIRECTIONS[NUM_LINE_DIRECTIONS];
+
+//------------------------------------------------------------------------------
+// Every window of WIN_LENGTH cells in a line that fits on the board, in any direction. A player
+// wins by filling one. Cells are Board bit indices, see Board::CellBit.
+enum
+{
+  MAX_WINDOWS = 4 * BOARD_WIDTH * BOARD_HEIGHT,
+  // a cell is in at most WIN_LENGTH windows in each direction
+  MAX_CELL_WINDOWS = 4 * WIN_LENGTH,
+};
+
+extern int NUM_WINDOWS;
+// cells of each window
+extern int WINDOW_CELLS[MAX_WINDOWS][WIN_LENGTH];
+// the windows each cell is in
+extern int CELL_WINDOWS[BitBoard::NUM_BITS][MAX_CELL_WINDOWS];
+extern int CELL_NUM_WINDOWS[BitBoard::NUM_BITS];
+// the cells a window going in each of LINE_DIRECTIONS can start in and stay on the board
+extern BitBoard WINDOW_STARTS[NUM_LINE_DIRECTIONS];
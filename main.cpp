@@ -1,4 +1,5 @@
 #include "ai_player.hpp"
+#include "bench.hpp"
 #include "board.hpp"
 #include "game_state.hpp"
 #include "mcts.hpp"
@@ -106,6 +107,13 @@ int main(int argc, char** argv)
 {
   srand(1337);
 
+  // "bench [threads]" runs the thread scaling benchmark instead of the game
+  if (argc > 1 && string(argv[1]) == "bench")
+  {
+    RunScalingBenchmark(argc > 2 ? atoi(argv[2]) : (int)thread::hardware_concurrency());
+    return 0;
+  }
+
   if (SDL_Init(SDL_INIT_VIDEO) != 0)
   {
     printf("SDL_Init Error: %s\n", SDL_GetError());
@@ -140,11 +148,20 @@ int main(int argc, char** argv)
   SDL_Color color = {255, 255, 255, 255};
   SDL_Texture* winnerTexture = nullptr;
 
+  // think on the human's time too
+  MCTSConfig mctsConfig;
+  mctsConfig.ponder = true;
+  mctsConfig.playoutPolicy = PLAYOUT_THREATS;
+
   // clang-format off
 
   GameState state({
     new Player{ 1, nullptr },
-    new Player{ 2, new MCTS(2)}});
+    new Player{ 2, new MCTS(2, mctsConfig)}});
+
+  //GameState state({
+  //  new Player{1, new MiniMax(1)},
+  //  new Player{2, new MCTS(2)}});
 
   //GameState state({
   //  new Player{1, new MCTS{1}}, 
@@ -153,6 +170,9 @@ int main(int argc, char** argv)
 
   // clang-format on
   int dropPosition = 0;
+  bool gameOver = false;
+  // the AI thinks in the background, so the window keeps rendering while it does
+  ThinkHandle* thinkHandle = nullptr;
 
   while (true)
   {
@@ -163,6 +183,17 @@ int main(int argc, char** argv)
     if (winner == NO_WINNER && state.board.IsBoardFull())
       winner = GAME_END_DRAW;
 
+    if (winner != NO_WINNER && !gameOver)
+    {
+      // stop the AIs from pondering a finished game
+      for (Player* p : state.players.data)
+      {
+        if (p->ai)
+          p->ai->GameOver();
+      }
+      gameOver = true;
+    }
+
     bool done = false;
     int playerMove = -1;
     SDL_Event e;
@@ -177,6 +208,10 @@ int main(int argc, char** argv)
           break;
         }
 
+        // space makes the AI play its best move so far
+        if (key == SDLK_SPACE && thinkHandle)
+          thinkHandle->Stop();
+
         if (!curPlayer->ai && winner == NO_WINNER)
         {
           if (key == SDLK_LEFT)
@@ -225,13 +260,35 @@ int main(int argc, char** argv)
           state.players.Next();
         }
       }
-      else
+      else if (!thinkHandle)
+      {
+        thinkHandle = curPlayer->ai->StartThink(state);
+      }
+      else if (thinkHandle->Done())
       {
-        curPlayer->ai->Think(&state);
+        int move = thinkHandle->Wait();
+        delete thinkHandle;
+        thinkHandle = nullptr;
+        state.board.ApplyMove(move, curPlayer->id);
+        state.moves.push_back(move);
         state.players.Next();
       }
     }
 
+    if (thinkHandle)
+    {
+      ThinkStatus status = thinkHandle->Status();
+      char title[256];
+      sprintf_s(title,
+          sizeof(title),
+          "Player %d thinking: best move %d, %d playouts, %u ms",
+          curPlayer->id,
+          status.bestMove,
+          status.totalPlayed,
+          status.elapsedMs);
+      SDL_SetWindowTitle(g_window, title);
+    }
+
     RenderBoard(20, 20, dropPosition, state);
 
     if (winner != NO_WINNER)
@@ -256,6 +313,7 @@ int main(int argc, char** argv)
     SDL_RenderPresent(g_renderer);
   }
 
+  delete thinkHandle;
   SDL_DestroyRenderer(g_renderer);
   SDL_DestroyWindow(g_window);
   SDL_Quit();
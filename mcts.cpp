@@ -6,286 +6,975 @@
 #include "mcts.hpp"
 #include "board.hpp"
 #include "game_state.hpp"
+#include "ucb.hpp"
 
 #define WITH_REFINMENT 1
 
 //------------------------------------------------------------------------------
-MCTS::MCTS(int playerId) : AIPlayer(playerId)
+MCTS::MCTS(int playerId, const MCTSConfig& config)
+    : AIPlayer(playerId)
+    , config(config)
 {
-  nodeBufs[0] = new TreeNode[TOTAL_NODES];
-  nodeBufs[1] = new TreeNode[TOTAL_NODES];
-  memset(nodeBufs[0], 0, sizeof(TreeNode) * TOTAL_NODES);
-  memset(nodeBufs[1], 0, sizeof(TreeNode) * TOTAL_NODES);
-  curBuf = 0;
+  int numThreads = max(1, config.numThreads);
+  int numArenas = config.parallelMode == PARALLEL_TREE ? 1 : numThreads;
+  for (int i = 0; i < numArenas; ++i)
+  {
+    arenas.push_back(new NodeArena(config.maxTreeNodes + NUM_BUFFER_NODES,
+        config.hugePages,
+        config.rave));
+  }
+
+  for (int i = 0; i < numThreads; ++i)
+    workers.push_back(new SearchWorker(arenas[min(i, numArenas - 1)], config.seed + i));
+
+  if (config.parallelMode == PARALLEL_TREE && numThreads > 1)
+    virtualLoss = config.virtualLoss;
+  if (config.batchSize > 1)
+    playoutsPerVisit = min((int)PlayoutBatch::MAX_LANES, config.batchSize);
+
+  timeBankMs = config.gameTimeMs;
 }
 
 //------------------------------------------------------------------------------
 MCTS::~MCTS()
 {
-  delete[] nodeBufs[0];
-  delete[] nodeBufs[1];
+  StopPondering();
+  for (SearchWorker* worker : workers)
+    delete worker;
+  for (NodeArena* arena : arenas)
+    delete arena;
 }
 
 //------------------------------------------------------------------------------
 void MCTS::Think(GameState* state)
+{
+  // the opponent has moved, so stop searching on their time. The tree is reused below.
+  StopPondering();
+  {
+    lock_guard<mutex> lock(treeMutex);
+    thinkStarted = false;
+  }
+
+  numPlayers = (int)state->players.Size();
+
+  // a new game gets a new time bank
+  if (state->moves.size() < rootMoveIdx)
+    timeBankMs = config.gameTimeMs;
+
+  // With only one valid move there is nothing to think about. The tree is kept, and is found
+  // again by following the moves on the next think.
+  if (PopCount64(state->board.validMoves) == 1)
+  {
+    int move = LowestBit64(state->board.validMoves);
+    if (config.verbose)
+      printf("only one valid move: %d\n", move);
+    state->board.ApplyMove(move, playerId);
+    state->moves.push_back(move);
+    StartPondering(state);
+    return;
+  }
+
+  PrepareSearch(state, playerId, config.limits);
+  // playouts kept from the previous search, and from pondering
+  int reusedPlayouts = arenas[0]->stats[0].numPlayed;
+  u32 bankMs = config.gameTimeMs ? max(1u, timeBankMs) : 0;
+  timeManager.StartMove(config.limits.maxTimeMs, bankMs, state->board, numPlayers);
+  maxTimeMs = timeManager.maxMs;
+
+  RunSearch();
+  if (config.gameTimeMs)
+    timeBankMs -= min(timeBankMs, thinkMs);
+
+  u64 treeNodes = 0, highWater = 0;
+  size_t committedBytes = 0;
+  int rootProof = PROOF_NONE;
+  for (const NodeArena* arena : arenas)
+  {
+    treeNodes += arena->nodesUsed;
+    highWater += arena->HighWater();
+    committedBytes += arena->CommittedBytes();
+    if (AtomicLoad(&arena->nodes[0].proof) != PROOF_NONE)
+      rootProof = AtomicLoad(&arena->nodes[0].proof);
+  }
+
+  if (config.verbose)
+  {
+    printf("%d iterations on %d threads, %.0f iterations/s, %.0f playouts/s\n",
+        iterations,
+        (int)workers.size(),
+        iterations * 1000.0 / thinkMs,
+        iterations * playoutsPerVisit * 1000.0 / thinkMs);
+    printf("%d playouts reused from the previous search\n", reusedPlayouts);
+    printf("%llu tree nodes (%.2f nodes/iteration), %d transpositions\n",
+        (unsigned long long)treeNodes,
+        (double)treeNodes / max(1, iterations),
+        transpositions);
+    printf("%d nodes allocated, %.1f per 1000 iterations\n",
+        nodesAllocated,
+        nodesAllocated * 1000.0 / max(1, iterations));
+    if (rootProof != PROOF_NONE)
+    {
+      printf("solved: %s\n",
+          rootProof == PROOF_DRAW ? "draw" : rootProof == playerId ? "win" : "loss");
+    }
+    printf("selection: %.1f levels/iteration", (double)selectionLevels / max(1, iterations));
+    if (config.profileSelection)
+      printf(", %.1f ns/level", (double)selectionNs / max<u64>(1, selectionLevels));
+    printf("\n");
+    printf("high water: %llu nodes, %.1f MB committed\n",
+        (unsigned long long)highWater,
+        committedBytes / (1024.0 * 1024.0));
+    printf("time: %u ms (target %u ms, max %u ms), %u ms left in the bank\n",
+        thinkMs,
+        timeManager.targetMs,
+        timeManager.maxMs,
+        timeBankMs);
+  }
+
+  int bestMove = BestMove();
+  state->board.ApplyMove(bestMove, playerId);
+  state->moves.push_back(bestMove);
+
+  StartPondering(state);
+}
+
+//------------------------------------------------------------------------------
+void MCTS::GameOver()
+{
+  StopPondering();
+}
+
+//------------------------------------------------------------------------------
+bool MCTS::GetThinkStatus(ThinkStatus* status)
+{
+  // Until the trees have been set up for this think, they hold the previous search, or the
+  // pondering one
+  lock_guard<mutex> lock(treeMutex);
+  if (!thinkStarted)
+    return false;
+
+  RootSummary root = SummarizeRoot();
+  if (root.bestMove == -1)
+    return false;
+
+  status->bestMove = root.bestMove;
+  status->bestPlayed = root.bestPlayed;
+  status->totalPlayed = root.totalPlayed;
+  status->bestWinRate = root.bestWinRate;
+  status->elapsedMs = 0;
+  status->done = false;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void MCTS::StartPondering(GameState* state)
+{
+  // Keep searching from the position after our move while the opponents think. Their moves are
+  // then already in the tree when it's our turn again.
+  if (!config.ponder || config.limits.deterministic)
+    return;
+
+  if (state->board.Winner().player != NO_WINNER || state->board.IsBoardFull())
+    return;
+
+  // only the tree size limits apply, the search runs until StopPondering
+  SearchLimits limits;
+  limits.maxTimeMs = 0;
+  limits.maxNodes = config.limits.maxNodes;
+  limits.maxMemoryBytes = config.limits.maxMemoryBytes;
+
+  PrepareSearch(state, 1 + (playerId % numPlayers), limits);
+  maxTimeMs = 0;
+  ponderThread = thread([this] { RunSearch(); });
+}
+
+//------------------------------------------------------------------------------
+void MCTS::StopPondering()
+{
+  if (!ponderThread.joinable())
+    return;
+
+  AtomicStore(&stopSearch, 1);
+  ponderThread.join();
+  if (config.verbose)
+    printf("pondered %d iterations in %u ms\n", iterations, thinkMs);
+}
+
+//------------------------------------------------------------------------------
+void MCTS::PrepareSearch(GameState* state, int rootPlayer, const SearchLimits& limits)
+{
+  lock_guard<mutex> lock(treeMutex);
+  for (NodeArena* arena : arenas)
+    PrepareTree(arena, state, rootPlayer);
+
+  rootBoard = state->board;
+  rootMoveIdx = state->moves.size();
+  pondering = rootPlayer != playerId;
+  thinkStarted = !pondering;
+
+  searchLimits = limits;
+  maxNodes = config.maxTreeNodes;
+  if (limits.maxNodes)
+    maxNodes = min(maxNodes, limits.maxNodes);
+  if (limits.maxMemoryBytes)
+  {
+    size_t bytesPerNode = sizeof(TreeNode) + sizeof(NodeStats) * (config.rave ? 2 : 1);
+    if (config.transpositionTableBits)
+      bytesPerNode += sizeof(TranspositionTable::Entry) / TranspositionTable::NODES_PER_ENTRY;
+    maxNodes = (u32)min<size_t>(maxNodes, limits.maxMemoryBytes / arenas.size() / bytesPerNode);
+  }
+
+  // Size the transposition tables for the nodes this search can use, instead of always allocating
+  // the largest table. The size is rounded down, so they stay inside the memory budget.
+  int tableBits = 0;
+  while (tableBits < config.transpositionTableBits
+      && ((u64)2 << tableBits) * TranspositionTable::NODES_PER_ENTRY <= maxNodes)
+  {
+    ++tableBits;
+  }
+  for (NodeArena* arena : arenas)
+    arena->table.Resize(tableBits);
+  iterationsStarted = 0;
+  stopSearch = 0;
+
+  // In deterministic mode each worker runs a fixed share of the iterations, so the result doesn't
+  // depend on how the threads are scheduled. There is no other limit then, so 0 can't mean no
+  // limit, and a default count is used instead.
+  int numIterations = limits.maxIterations;
+  if (numIterations == 0)
+    numIterations = SearchLimits::DEFAULT_DETERMINISTIC_ITERATIONS;
+  int numWorkers = (int)workers.size();
+  for (int i = 0; i < numWorkers; ++i)
+  {
+    workers[i]->deterministicIterations =
+        numIterations / numWorkers + (i < numIterations % numWorkers ? 1 : 0);
+  }
+}
+
+//------------------------------------------------------------------------------
+void MCTS::RunSearch()
+{
+  // The calling thread searches as worker 0, and the others get a thread each. With root
+  // parallelism the workers don't share anything that's written to, and with tree parallelism
+  // the shared nodes are only updated atomically.
+  startTime = chrono::steady_clock::now();
+  deadline = startTime + chrono::milliseconds(maxTimeMs);
+  vector<thread> threads;
+  for (size_t i = 1; i < workers.size(); ++i)
+  {
+    SearchWorker* worker = workers[i];
+    threads.push_back(thread([this, worker] { Search(*worker); }));
+  }
+  Search(*workers[0]);
+  for (thread& t : threads)
+    t.join();
+  thinkMs = max(1u, (u32)chrono::duration_cast<chrono::milliseconds>(
+      chrono::steady_clock::now() - startTime).count());
+
+  iterations = 0;
+  transpositions = 0;
+  nodesAllocated = 0;
+  selectionLevels = 0;
+  selectionNs = 0;
+  for (const SearchWorker* worker : workers)
+  {
+    iterations += worker->iterations;
+    transpositions += worker->transpositions;
+    nodesAllocated += worker->nodesAllocated;
+    selectionLevels += worker->selectionLevels;
+    selectionNs += worker->selectionNs;
+  }
+}
+
+//------------------------------------------------------------------------------
+void MCTS::PrepareTree(NodeArena* arena, GameState* state, int rootPlayer)
 {
 #if WITH_REFINMENT
-  if (nodesUsed == 0 || doReset)
+  if (arena->nodesUsed == 0 || doReset)
   {
-    nodesUsed = 0;
-    memset(nodeBufs[curBuf], 0, sizeof(TreeNode) * TOTAL_NODES);
+    arena->Reset();
 
     // Create the first node
-    AddNode(nullptr, state->board, playerId);
+    AddRoot(arena, rootPlayer);
   }
   else
   {
-    if (!CompactTree(state))
+    if (!CompactTree(arena, state))
     {
-      AddNode(nullptr, state->board, playerId);
+      arena->Reset();
+      AddRoot(arena, rootPlayer);
     }
   }
 #else
-  nodesUsed = 0;
-  memset(nodeBufs[curBuf], 0, sizeof(TreeNode) * TOTAL_NODES);
+  arena->Reset();
 
   // Create the first node
-  AddNode(nullptr, state->board, playerId);
+  AddRoot(arena, rootPlayer);
 
 #endif
+}
 
-  u32 startTime = timeGetTime();
-  u32 elapsedTime = 0;
-  int runs = 0;
-  while (nodesUsed < MAX_TREE_NODES && elapsedTime < 2500)
+//------------------------------------------------------------------------------
+void MCTS::Search(SearchWorker& worker)
+{
+  // the clock is checked about this often, and at least twice in the last check period
+  static const s64 CHECK_PERIOD_NS = 500 * 1000;
+  static const int MAX_CHECK_INTERVAL = 10000;
+
+  NodeArena* arena = worker.arena;
+  worker.board = rootBoard;
+  if (config.playoutPolicy == PLAYOUT_THREATS)
+    worker.rootThreats.Init(rootBoard);
+  worker.iterations = 0;
+  worker.transpositions = 0;
+  worker.nodesAllocated = 0;
+  worker.selectionLevels = 0;
+  worker.selectionNs = 0;
+
+  const SearchLimits& limits = searchLimits;
+
+  // Instead of checking the clock every N iterations, N is picked from the measured iteration
+  // cost, so the deadline is hit with the same accuracy for cheap and expensive iterations
+  int nextClockCheck = 0;
+  int lastCheckIteration = 0;
+  auto lastCheckTime = chrono::steady_clock::now();
+
+  bool timed = maxTimeMs && !limits.deterministic;
+  // a think started from a ThinkHandle can be stopped by the caller, but that doesn't apply to
+  // pondering, which is stopped by the next think
+  const u32* stopThink = pondering ? &stopSearch : &stopThinking;
+  while (AtomicLoad(&arena->nodesUsed) < maxNodes && !AtomicLoad(&stopSearch)
+      && !AtomicLoad(stopThink))
   {
-    // NB: we compare runs here, in case we run boards with less than 1000 states, in which
-    // case this won't be trigged if we compare against nodesUsed
-    if ((runs++ % 1000) == 0)
+    // Once the root is proven, more iterations can't change the move. In deterministic mode the
+    // other trees carry on, so the result doesn't depend on the scheduling.
+    if (AtomicLoad(&arena->nodes[0].proof) != PROOF_NONE)
+    {
+      if (!limits.deterministic)
+        AtomicStore(&stopSearch, 1);
+      break;
+    }
+
+    if (limits.deterministic)
+    {
+      if (worker.iterations >= worker.deterministicIterations)
+        break;
+    }
+    else
     {
-      elapsedTime = timeGetTime() - startTime;
+      if (limits.maxIterations && AtomicAdd(&iterationsStarted, 1) >= limits.maxIterations)
+        break;
+
+      if (timed && worker.iterations >= nextClockCheck)
+      {
+        auto now = chrono::steady_clock::now();
+        s64 remainingNs = chrono::duration_cast<chrono::nanoseconds>(deadline - now).count();
+        if (remainingNs <= 0)
+          break;
+
+        // the first worker runs the time management for everyone
+        if (&worker == workers[0])
+        {
+          u32 elapsedMs =
+              (u32)chrono::duration_cast<chrono::milliseconds>(now - startTime).count();
+          if (timeManager.ShouldStop(elapsedMs, SummarizeRoot(), config.earlyStop))
+          {
+            AtomicStore(&stopSearch, 1);
+            break;
+          }
+        }
+
+        // nothing has been measured on the first check, so the next one is after 1 iteration
+        s64 interval = 1;
+        if (worker.iterations > lastCheckIteration)
+        {
+          s64 elapsedNs = chrono::duration_cast<chrono::nanoseconds>(now - lastCheckTime).count();
+          s64 nsPerIteration = elapsedNs / (worker.iterations - lastCheckIteration);
+          interval = min(CHECK_PERIOD_NS, remainingNs / 2) / max<s64>(1, nsPerIteration);
+          interval = min<s64>(MAX_CHECK_INTERVAL, max<s64>(1, interval));
+        }
+        nextClockCheck = worker.iterations + (int)interval;
+        lastCheckIteration = worker.iterations;
+        lastCheckTime = now;
+      }
     }
 
+    worker.iterations++;
+
     // MCTS executes the following 4 steps each run:
     // 1) selection - find an unexpanded child node, using UCB1 to determine the path to traverse
     // 2) expansion - create the new child
     // 3) simulation - choose random moves from the new child until we reach an end state for the game
     // 4) back propagation - propagate the results from the end state up to the root
 
-    TreeNode* node = FindExpansionNode(state);
-    SimulateFromNode(node, state);
+    u32 node;
+    if (config.profileSelection)
+    {
+      auto selectionStart = chrono::steady_clock::now();
+      node = FindExpansionNode(worker);
+      worker.selectionNs += chrono::duration_cast<chrono::nanoseconds>(
+          chrono::steady_clock::now() - selectionStart).count();
+    }
+    else
+    {
+      node = FindExpansionNode(worker);
+    }
+    SimulateFromNode(worker, node);
   }
-
-  int bestMove = BestMove();  
-  state->board.ApplyMove(bestMove, playerId);
-  state->moves.push_back(bestMove);
 }
 
 //------------------------------------------------------------------------------
-MCTS::TreeNode* MCTS::FindExpansionNode(GameState* state)
+u32 MCTS::FindExpansionNode(SearchWorker& worker)
 {
-  TreeNode* nodes = nodeBufs[curBuf];
-  TreeNode* node = &nodes[0];
+  NodeArena* arena = worker.arena;
+  u32 node = 0;
+  worker.path.clear();
+  worker.path.push_back(node);
 
   while (true)
   {
-    float logParentPlayed = node->numPlayed ? (float)log(node->numPlayed) : 0;
-
-    // either select the child with the best UCB1, or the first unexpanded child
-    float bestChildScore = 0.f;
-    TreeNode* bestChild = nullptr;
-    int unvisitedChildren[BOARD_WIDTH];
-    int numUnvisitedChildren = 0;
-    int numValidMoves = 0;
-    for (int i = 0; i < BOARD_WIDTH; ++i)
+    worker.selectionLevels++;
+    const TreeNode& cur = arena->nodes[node];
+    u32 firstChild = AtomicLoad(&cur.firstChild);
+    if (firstChild == INVALID_NODE || firstChild == EXPANDING_NODE)
     {
-      if (!node->board.ValidMove(i))
+      // Leaf node, so create its children, and pick one of them as the node to simulate from. If
+      // the leaf hasn't been visited often enough yet, there are no valid moves, the arena is
+      // full, or another thread is already expanding the node, use the leaf itself. If the
+      // position has already been expanded from another path, the leaf now shares those
+      // children, and the selection carries on through them. NB: the leaf's numPlayed counts
+      // playouts, and includes the virtual loss it got on the way down, which isn't a visit.
+      bool expand = firstChild == INVALID_NODE
+          && (node == 0
+              || arena->stats[node].numPlayed - virtualLoss
+                  >= config.expansionThreshold * playoutsPerVisit);
+      bool linked = false;
+      u32 child = expand ? ExpandNode(worker, node, &linked) : INVALID_NODE;
+      if (linked)
         continue;
-
-      numValidMoves++;
-      if (TreeNode* curChild = node->children[i])
-      {
-        // upper confidence bound
-        float C = 2.0f;
-        float childScore = curChild->numWon / curChild->numPlayed
-          + sqrtf(C + logParentPlayed / curChild->numPlayed);
-        if (childScore > bestChildScore || !bestChild)
-        {
-          bestChild = curChild;
-          bestChildScore = childScore;
-        }
-      }
-      else
-      {
-        // found unexpanded child
-        unvisitedChildren[numUnvisitedChildren++] = i;
-      }
+      if (child == INVALID_NODE)
+        return node;
+
+      if (virtualLoss)
+        AtomicAdd(&arena->stats[child].numPlayed, virtualLoss);
+      ApplyChildMove(worker, child, cur.player, true);
+      worker.path.push_back(child);
+      return child;
     }
 
-    if (numUnvisitedChildren)
+    // Proven children are skipped. If they all are, another thread is about to prove the node,
+    // so it's simulated from instead.
+    u32 provenChildren = AtomicLoad(&cur.provenChildren);
+    if (provenChildren == (1u << cur.numChildren) - 1)
+      return node;
+
+    // A node that shares its children with a transposition has fewer visits than they have
+    // together, so the children's total is used for the exploration term
+    int parentPlayed = arena->stats[node].numPlayed;
+    if (arena->nodes[firstChild].parent != node)
     {
-      // Found unexpanded child, so assign it to the next player, and update its state
-      int numPlayers = (int)state->players.Size();
-      int move = unvisitedChildren[rand() % numUnvisitedChildren];
-      Board newBoard = node->board;
-      newBoard.ApplyMove(move, node->player);
-      int nextPlayer = 1 + (node->player % numPlayers);
-      TreeNode* leafNode = AddNode(node, newBoard, nextPlayer);
-      node->children[move] = leafNode;
-      return leafNode;
+      parentPlayed = 1;
+      for (int i = 0; i < cur.numChildren; ++i)
+        parentPlayed += arena->stats[firstChild + i].numPlayed;
     }
-    else if (numValidMoves > 0)
+
+    // either select the child with the best UCB1, or one of the unvisited children. All children
+    // are in one block, so this only touches the stats array.
+    // NB: other threads might be updating the stats, so they can be slightly out of date, but
+    // aligned 32 bit reads are never torn.
+    bool unvisited;
+    int bestChild;
+    if (config.rave)
     {
-      node = bestChild;
+      bestChild = SelectChildRAVE(&arena->stats[firstChild],
+          &arena->amaf[firstChild],
+          cur.numChildren,
+          parentPlayed,
+          config.explorationConstant,
+          config.raveEquivalence,
+          provenChildren,
+          worker.rng,
+          &unvisited);
     }
     else
     {
-      // no valid moves, so use the last node as the leaf node, and break
-      return node;
+      bestChild = SelectChildUCB1(&arena->stats[firstChild],
+          cur.numChildren,
+          parentPlayed,
+          config.explorationConstant,
+          provenChildren,
+          worker.rng,
+          &unvisited);
     }
+
+    u32 child = firstChild + bestChild;
+    if (virtualLoss)
+      AtomicAdd(&arena->stats[child].numPlayed, virtualLoss);
+    ApplyChildMove(worker, child, cur.player, unvisited);
+    worker.path.push_back(child);
+
+    // An unvisited child is used as the leaf node, and so is a proven child, which can be reached
+    // through a node sharing the children that hasn't seen the proof yet
+    if (unvisited || AtomicLoad(&arena->nodes[child].proof) != PROOF_NONE)
+      return child;
+
+    node = child;
   }
 
-  return nullptr;
+  return INVALID_NODE;
 }
 
 //------------------------------------------------------------------------------
-void MCTS::SimulateFromNode(TreeNode* node, GameState* state)
+void MCTS::ApplyChildMove(SearchWorker& worker, u32 child, int player, bool firstVisit)
 {
-  // Randomly simulate while we're not in an end state
-  Board board = node->board;
-  int numPlayers = (int)state->players.Size();
-  int player = node->player;
-  while (board.Winner().player == NO_WINNER && !board.IsBoardFull())
-  {
-    // pick random move
-    vector<int> validMoves = board.GetValidMoves();
-    int move = validMoves[rand() % validMoves.size()];
-    board.ApplyMove(move, player);
-    // create a new tree node for the current state
-    player = 1 + (player % numPlayers);
-    TreeNode* newNode = AddNode(node, board, player);
-    node->children[move] = newNode;
-    node = newNode;
-  }
-  // back propagation
-  int winningPlayer = board.Winner().player;
-  while (node)
+  // Plays the move leading to 'child' on the working board. The first time a child is visited,
+  // it's also checked for the end of the game, which makes it a proven node for the solver.
+  TreeNode& node = worker.arena->nodes[child];
+  if (!firstVisit || !config.solver)
   {
-    node->numPlayed++;
-    if (node->parent && winningPlayer == node->parent->player)
-      node->numWon++;
-    node = node->parent;
+    worker.board.ApplyMove(node.move, player);
+    return;
   }
+
+  if (worker.board.ApplyMoveCheckWin(node.move, player).won)
+    AtomicStore(&node.proof, (u8)player);
+  else if (worker.board.IsBoardFull())
+    AtomicStore(&node.proof, (u8)PROOF_DRAW);
 }
 
 //------------------------------------------------------------------------------
-MCTS::TreeNode* MCTS::AddNode(TreeNode* parent, const Board& board, int player)
+bool MCTS::UpdateProof(NodeArena* arena, u32 node, u32 child)
 {
-  TreeNode* nodes = nodeBufs[curBuf];
-  TreeNode* newNode = &nodes[nodesUsed++];
-  newNode->parent = parent;
-  newNode->board = board;
-  newNode->player = player;
-  return newNode;
+  // Called when 'child' of 'node' has been proven, and returns true if that proves the node too.
+  // The player to move wins if any of the moves wins for them. Otherwise the node is only proven
+  // once all of its children are, and then the player takes a draw if there is one.
+  TreeNode& parent = arena->nodes[node];
+  u32 firstChild = AtomicLoad(&parent.firstChild);
+  u32 bit = 1u << (child - firstChild);
+  u32 provenChildren = AtomicOr(&parent.provenChildren, bit) | bit;
+
+  int proof = AtomicLoad(&arena->nodes[child].proof);
+  if (proof == parent.player)
+  {
+    AtomicStore(&parent.proof, (u8)proof);
+    return true;
+  }
+
+  if (provenChildren != (1u << parent.numChildren) - 1)
+    return false;
+
+  // NB: with more than 2 players, the moves can lose to different players. Which one wins then
+  // depends on the player to move, so the most visited move is assumed.
+  int bestPlayed = -1;
+  for (int i = 0; i < parent.numChildren; ++i)
+  {
+    int childProof = AtomicLoad(&arena->nodes[firstChild + i].proof);
+    if (childProof == PROOF_DRAW)
+    {
+      proof = PROOF_DRAW;
+      break;
+    }
+
+    if (arena->stats[firstChild + i].numPlayed > bestPlayed)
+    {
+      proof = childProof;
+      bestPlayed = arena->stats[firstChild + i].numPlayed;
+    }
+  }
+
+  AtomicStore(&parent.proof, (u8)proof);
+  return true;
 }
 
 //------------------------------------------------------------------------------
-int MCTS::BestMove()
+u32 MCTS::ExpandNode(SearchWorker& worker, u32 node, bool* linked)
 {
-  TreeNode* nodes = nodeBufs[curBuf];
-
-  struct SortNode
+  // Creates a child for every valid move, and returns a random one of them, or INVALID_NODE if the
+  // node has no valid moves, or another thread got to it first. If another node holds the same
+  // position, and has been expanded, its children are shared instead, and 'linked' is set.
+  NodeArena* arena = worker.arena;
+  TreeNode& parent = arena->nodes[node];
+  if (!AtomicCompareExchange(&parent.firstChild, INVALID_NODE, EXPANDING_NODE))
+    return INVALID_NODE;
+
+  u32 validMoves = worker.board.validMoves;
+  int numChildren = PopCount64(validMoves);
+  u64 hash = worker.board.hash;
+  if (!arena->table.entries.empty())
   {
-    int numPlayed;
-    int numWon;
-    int idx;
-  };
+    u32 other = arena->table.Find(hash);
+    u32 otherChild = other != INVALID_NODE ? AtomicLoad(&arena->nodes[other].firstChild) : other;
+    if (otherChild != INVALID_NODE && otherChild != EXPANDING_NODE)
+    {
+      // make sure the children match the valid moves, in case two positions have the same hash
+      u32 childMoves = 0;
+      for (int i = 0; i < arena->nodes[other].numChildren; ++i)
+        childMoves |= 1u << arena->nodes[otherChild + i].move;
 
-  int numSortNodes = 0;
-  SortNode sortNodes[BOARD_WIDTH];
-  for (int i = 0; i < BOARD_WIDTH; ++i)
+      if (childMoves == validMoves)
+      {
+        parent.numChildren = (u8)numChildren;
+        AtomicStore(&parent.firstChild, otherChild);
+        worker.transpositions++;
+        *linked = true;
+        return INVALID_NODE;
+      }
+    }
+  }
+
+  u32 firstChild = numChildren ? arena->Alloc(numChildren) : INVALID_NODE;
+  if (firstChild == INVALID_NODE)
   {
-    TreeNode* node = nodes[0].children[i];
-    if (node)
-      sortNodes[numSortNodes++] = SortNode{ node->numPlayed, node->numWon, i };
+    AtomicStore(&parent.firstChild, INVALID_NODE);
+    return INVALID_NODE;
   }
 
-  sort(sortNodes, sortNodes + numSortNodes, [](const SortNode& lhs, const SortNode& rhs)
+  worker.nodesAllocated += numChildren;
+  int nextPlayer = 1 + (parent.player % numPlayers);
+  for (int i = 0; i < numChildren; ++i)
   {
-    return lhs.numWon / max(1.0f, (float)lhs.numPlayed) > rhs.numWon / max(1.0f, (float)rhs.numPlayed);
-  });
+    int move = LowestBit64(validMoves);
+    validMoves &= validMoves - 1;
+
+    TreeNode& child = arena->nodes[firstChild + i];
+    child.parent = node;
+    child.firstChild = INVALID_NODE;
+    child.numChildren = 0;
+    child.move = (u8)move;
+    child.player = (u8)nextPlayer;
+    child.proof = PROOF_NONE;
+    child.provenChildren = 0;
+    arena->stats[firstChild + i] = NodeStats{0, 0};
+    if (arena->amaf)
+      arena->amaf[firstChild + i] = NodeStats{0, 0};
+  }
+
+  // publish the children. numChildren has to be written first, as other threads only read it
+  // after seeing the new firstChild.
+  parent.numChildren = (u8)numChildren;
+  AtomicStore(&parent.firstChild, firstChild);
+  if (!arena->table.entries.empty())
+    arena->table.Insert(hash, node);
+
+  return firstChild + worker.rng.Range(numChildren);
+}
 
-  for (int i = 0; i < numSortNodes; ++i)
+//------------------------------------------------------------------------------
+u32 MCTS::AddRoot(NodeArena* arena, int player)
+{
+  u32 root = arena->Alloc(1);
+  if (root == INVALID_NODE)
   {
-    printf("%d: %d/%d\n", sortNodes[i].idx, sortNodes[i].numWon, sortNodes[i].numPlayed);
+    printf("Unable to allocate the root node\n");
+    abort();
   }
-  printf("%d total nodes\n", nodes[0].numPlayed);
 
-  return sortNodes[0].idx;
+  TreeNode& node = arena->nodes[root];
+  node.parent = INVALID_NODE;
+  node.firstChild = INVALID_NODE;
+  node.numChildren = 0;
+  node.move = 0;
+  node.player = (u8)player;
+  node.proof = PROOF_NONE;
+  node.provenChildren = 0;
+  arena->stats[root] = NodeStats{0, 0};
+  if (arena->amaf)
+    arena->amaf[root] = NodeStats{0, 0};
+  return root;
 }
 
 //------------------------------------------------------------------------------
-MCTS::TreeNode* MCTS::CompactNode(TreeNode* node, TreeNode* parent, TreeNode* nodes)
+void MCTS::SimulateFromNode(SearchWorker& worker, u32 node)
 {
-  // Copy over the fields we want to the new node
-  TreeNode* newNode = nodes + nodesUsed;
-  newNode->parent = parent;
-  newNode->board = node->board;
-  newNode->numPlayed = node->numPlayed;
-  newNode->numWon = node->numWon;
-  newNode->player = node->player;
-  nodesUsed++;
+  NodeArena* arena = worker.arena;
 
-  for (int i = 0; i < BOARD_WIDTH; ++i)
+  // Randomly simulate on a scratch board. Only the expanded node is kept in the tree, the moves
+  // of the playout itself are thrown away.
+  int numPlayouts = playoutsPerVisit;
+  int numWins[MAX_PLAYERS + 1] = {0};
+  int player = arena->nodes[node].player;
+  int proof = AtomicLoad(&arena->nodes[node].proof);
+
+  if (proof != PROOF_NONE)
+  {
+    // the result is already known, so there is nothing to simulate
+    if (proof != PROOF_DRAW)
+      numWins[proof] = numPlayouts;
+  }
+  else if (config.playoutPolicy == PLAYOUT_THREATS || config.rave)
+  {
+    // The threat checks are per board, and RAVE needs the moves of each playout, so these
+    // playouts are run one at a time. The threat state for the node is the root's, with the moves
+    // on the path applied.
+    if (config.playoutPolicy == PLAYOUT_THREATS)
+    {
+      const vector<u32>& path = worker.path;
+      worker.pathThreats = worker.rootThreats;
+      for (size_t i = 1; i < path.size(); ++i)
+        worker.pathThreats.ApplyMove(arena->nodes[path[i]].move, arena->nodes[path[i - 1]].player);
+    }
+
+    for (int i = 0; i < numPlayouts; ++i)
+    {
+      BitBoard cellsPlayed[MAX_PLAYERS + 1];
+      BitBoard* cells = config.rave ? cellsPlayed : nullptr;
+      int winner;
+      if (config.playoutPolicy == PLAYOUT_THREATS)
+      {
+        // the last playout can use the path state, instead of a copy of it
+        ThreatPlayout* playout = &worker.pathThreats;
+        if (i + 1 < numPlayouts)
+        {
+          worker.threatPlayout = worker.pathThreats;
+          playout = &worker.threatPlayout;
+        }
+        winner = playout->Run(player, numPlayers, config.playoutDepth, worker.rng, cells);
+      }
+      else
+      {
+        Board scratch = worker.board;
+        winner = Rollout(worker, scratch, player, cells);
+      }
+
+      numWins[winner]++;
+      if (config.rave)
+        UpdateAmaf(worker, cellsPlayed, winner);
+    }
+  }
+  else if (config.batchSize > 1)
+  {
+    worker.batch.Run(worker.board,
+        player,
+        numPlayers,
+        numPlayouts,
+        config.playoutDepth,
+        worker.rng,
+        numWins);
+  }
+  else
+  {
+    Board scratch = worker.board;
+    numWins[Rollout(worker, scratch, player, nullptr)]++;
+  }
+
+  // back propagation along the path that was taken, undoing the moves on the working board to get
+  // back to the root. Every node below the root got a virtual loss on the way down, which is
+  // replaced by the real result. A proof is passed up for as long as it proves the parent too.
+  const vector<u32>& path = worker.path;
+  bool proven = proof != PROOF_NONE;
+  for (size_t i = path.size() - 1; i > 0; --i)
   {
-    if (node->children[i])
+    u32 cur = path[i];
+    NodeStats& stats = arena->stats[cur];
+    AtomicAdd(&stats.numPlayed, numPlayouts - virtualLoss);
+    if (int numWon = numWins[arena->nodes[path[i - 1]].player])
+      AtomicAdd(&stats.numWon, numWon);
+    worker.board.UndoMove(arena->nodes[cur].move);
+    if (proven)
+      proven = UpdateProof(arena, path[i - 1], cur);
+  }
+  AtomicAdd(&arena->stats[0].numPlayed, numPlayouts);
+}
+
+//------------------------------------------------------------------------------
+void MCTS::UpdateAmaf(SearchWorker& worker, BitBoard* cellsPlayed, int winner)
+{
+  // Walk up the path, taking the pieces off a copy of the column heights, and adding each move on
+  // it to the cells played below the parent. Every child of the parent that lands on a cell its
+  // player went on to play gets the playout's result. This includes the child on the path.
+  NodeArena* arena = worker.arena;
+  const vector<u32>& path = worker.path;
+  u8 heights[BOARD_WIDTH];
+  memcpy(heights, worker.board.heights, sizeof(heights));
+  for (size_t i = path.size() - 1; i > 0; --i)
+  {
+    const TreeNode& parent = arena->nodes[path[i - 1]];
+    int player = parent.player;
+    int col = arena->nodes[path[i]].move;
+    cellsPlayed[player].Set(col * COLUMN_STRIDE + --heights[col]);
+
+    u32 firstChild = AtomicLoad(&parent.firstChild);
+    for (int j = 0; j < parent.numChildren; ++j)
     {
-      newNode->children[i] = CompactNode(node->children[i], newNode, nodes);
+      u32 child = firstChild + j;
+      int move = arena->nodes[child].move;
+      if (!cellsPlayed[player].Test(move * COLUMN_STRIDE + heights[move]))
+        continue;
+
+      NodeStats& amaf = arena->amaf[child];
+      AtomicAdd(&amaf.numPlayed, 1);
+      if (winner == player)
+        AtomicAdd(&amaf.numWon, 1);
     }
   }
+}
+
+//------------------------------------------------------------------------------
+int MCTS::Rollout(SearchWorker& worker, Board& board, int player, BitBoard* cellsPlayed)
+{
+  // the move leading to the board might already have ended the game
+  int winningPlayer = board.Winner().player;
+  int movesLeft = config.playoutDepth ? config.playoutDepth : BOARD_WIDTH * BOARD_HEIGHT;
+  while (winningPlayer == NO_WINNER && !board.IsBoardFull())
+  {
+    if (movesLeft-- == 0)
+      return PickLikelyWinner(board.pieces, numPlayers, worker.rng);
+
+    int move = PickRandomMove(worker, board);
+    // the cells each player played, for RAVE
+    if (cellsPlayed)
+      cellsPlayed[player].Set(move * COLUMN_STRIDE + board.heights[move]);
+    if (board.ApplyMoveCheckWin(move, player).won)
+      winningPlayer = player;
+    player = 1 + (player % numPlayers);
+  }
 
-  return newNode;
+  return winningPlayer;
 }
 
 //------------------------------------------------------------------------------
-bool MCTS::CompactTree(GameState* state)
+int MCTS::PickRandomMove(SearchWorker& worker, const Board& board)
 {
-  // Compact the tree, by making the current board state the new root, and copying in
-  // all children, creating a new tree buffer just containing "live" children.
-  TreeNode* src = nodeBufs[curBuf];
-  TreeNode* dst = nodeBufs[curBuf ^ 1];
+  // pick a random set bit from the valid moves mask, to avoid building a list of moves
+  u32 validMoves = board.validMoves;
+  return NthBit64(validMoves, worker.rng.Range(PopCount64(validMoves)));
+}
 
-  memset(dst, 0, sizeof(TreeNode) * TOTAL_NODES);
+//------------------------------------------------------------------------------
+int MCTS::MergeRootChildren(MoveStats* moves) const
+{
+  // Merge the root children of all the trees. They all start from the same root, so the children
+  // are matched up by move.
+  // NB: this can be called while searching, so the stats might be changing
+  MoveStats merged[BOARD_WIDTH];
+  for (int i = 0; i < BOARD_WIDTH; ++i)
+    merged[i] = MoveStats{ 0, 0, i, PROOF_NONE };
 
-  // BFS to find the node holding the current game state
-  deque<TreeNode*> nodes;
-  TreeNode* root = nullptr;
-  nodes.push_back(&src[0]);
-  while (!nodes.empty())
+  for (const NodeArena* arena : arenas)
   {
-    TreeNode* node = nodes.front();
-    nodes.pop_front();
+    const TreeNode& root = arena->nodes[0];
+    u32 firstChild = AtomicLoad(&root.firstChild);
+    if (firstChild == INVALID_NODE || firstChild == EXPANDING_NODE)
+      continue;
 
-    if (memcmp(node->board.state, state->board.state, sizeof(state->board)) == 0)
+    for (int i = 0; i < root.numChildren; ++i)
     {
-      root = node;
-      break;
+      u32 child = firstChild + i;
+      const NodeStats& stats = arena->stats[child];
+      MoveStats& move = merged[arena->nodes[child].move];
+      move.numPlayed += stats.numPlayed;
+      move.numWon += stats.numWon;
+      int proof = AtomicLoad(&arena->nodes[child].proof);
+      if (proof != PROOF_NONE)
+        move.proof = proof;
     }
+  }
+
+  int numMoves = 0;
+  for (u32 validMoves = rootBoard.validMoves; validMoves; validMoves &= validMoves - 1)
+    moves[numMoves++] = merged[LowestBit64(validMoves)];
+  return numMoves;
+}
+
+//------------------------------------------------------------------------------
+RootSummary MCTS::SummarizeRoot() const
+{
+  MoveStats moves[BOARD_WIDTH];
+  int numMoves = MergeRootChildren(moves);
 
-    for (int i = 0; i < BOARD_WIDTH; ++i)
+  RootSummary res = RootSummary{ -1, 0, 0, 0, 0 };
+  for (int i = 0; i < numMoves; ++i)
+  {
+    const MoveStats& move = moves[i];
+    res.totalPlayed += move.numPlayed;
+    if (res.bestMove == -1 || move.numPlayed > res.bestPlayed)
+    {
+      res.secondPlayed = res.bestPlayed;
+      res.bestMove = move.move;
+      res.bestPlayed = move.numPlayed;
+      res.bestWinRate = move.numWon / max(1.0f, (float)move.numPlayed);
+    }
+    else
     {
-      if (node->children[i])
-        nodes.push_back(node->children[i]);
+      res.secondPlayed = max(res.secondPlayed, move.numPlayed);
     }
   }
 
-  nodesUsed = 0;
-  if (root)
+  return res;
+}
+
+//------------------------------------------------------------------------------
+int MCTS::BestMove()
+{
+  // Play the most visited move. It's the one the search has the most confidence in, and it's what
+  // the time manager's early stop is based on. Moves the solver has proven to win come first,
+  // and moves proven to lose come last.
+  MoveStats sortNodes[BOARD_WIDTH];
+  int numSortNodes = MergeRootChildren(sortNodes);
+  int totalPlayed = 0;
+  for (const NodeArena* arena : arenas)
+    totalPlayed += arena->stats[0].numPlayed;
+
+  int player = arenas[0]->nodes[0].player;
+  auto rank = [player](const MoveStats& move) {
+    if (move.proof == player)
+      return 0;
+    return move.proof == PROOF_NONE || move.proof == PROOF_DRAW ? 1 : 2;
+  };
+
+  sort(sortNodes, sortNodes + numSortNodes, [&rank](const MoveStats& lhs, const MoveStats& rhs)
+  {
+    if (rank(lhs) != rank(rhs))
+      return rank(lhs) < rank(rhs);
+    if (lhs.numPlayed != rhs.numPlayed)
+      return lhs.numPlayed > rhs.numPlayed;
+    return lhs.numWon / max(1.0f, (float)lhs.numPlayed) > rhs.numWon / max(1.0f, (float)rhs.numPlayed);
+  });
+
+  if (config.verbose)
   {
-    CompactNode(root, nullptr, dst);
+    for (int i = 0; i < numSortNodes; ++i)
+    {
+      const MoveStats& move = sortNodes[i];
+      const char* proof = move.proof == PROOF_NONE ? ""
+          : move.proof == PROOF_DRAW ? " (draw)"
+          : move.proof == player ? " (win)" : " (loss)";
+      printf("%d: %d/%d%s\n", move.move, move.numWon, move.numPlayed, proof);
+    }
+    printf("%d total nodes\n", totalPlayed);
   }
-  curBuf ^= 1;
 
-  return root != nullptr;
+  return sortNodes[0].move;
 }
 
+//------------------------------------------------------------------------------
+bool MCTS::CompactTree(NodeArena* arena, GameState* state)
+{
+  // Compact the tree, by making the current board state the new root, and sliding its subtree
+  // down to the start of the arena. Everything else is thrown away.
+
+  // Follow the moves made since the last think to find the node holding the current game state
+  u32 root = INVALID_NODE;
+  if (state->moves.size() >= rootMoveIdx)
+  {
+    root = 0;
+    for (size_t i = rootMoveIdx; i < state->moves.size() && root != INVALID_NODE; ++i)
+      root = arena->FindChild(root, state->moves[i]);
+  }
+
+  if (root == INVALID_NODE)
+    return false;
+
+  auto startTime = chrono::steady_clock::now();
+  arena->KeepSubtree(root);
+  if (config.breadthFirstLayout)
+    arena->SortBreadthFirst();
+  if (config.verbose)
+  {
+    printf("kept %u nodes in %.1f ms\n",
+        arena->nodesUsed,
+        chrono::duration<double, milli>(chrono::steady_clock::now() - startTime).count());
+  }
+
+  return true;
+}
@@ -1,43 +1,232 @@
 #pragma once
 #include "ai_player.hpp"
 #include "board.hpp"
+#include "node_arena.hpp"
+#include "playout_batch.hpp"
+#include "rng.hpp"
+#include "search_limits.hpp"
+#include "threat_playout.hpp"
+#include "time_manager.hpp"
 
+//------------------------------------------------------------------------------
+enum ParallelMode
+{
+  // every thread grows its own tree from the root, and the root stats are merged at the end
+  PARALLEL_ROOT,
+  // all threads work on the same tree
+  PARALLEL_TREE,
+};
+
+//------------------------------------------------------------------------------
+enum PlayoutPolicy
+{
+  // uniformly random moves
+  PLAYOUT_RANDOM,
+  // winning moves first, then blocks of the other players' wins, then random moves. See
+  // ThreatPlayout.
+  PLAYOUT_THREATS,
+};
+
+//------------------------------------------------------------------------------
+struct MCTSConfig
+{
+  // seed for the searcher's random number generator. The same seed gives the same search.
+  u64 seed = 1337;
+  SearchLimits limits;
+  // Thinking time for the whole game. When set, each move gets a share of what's left, weighted
+  // by game phase, instead of limits.maxTimeMs.
+  u32 gameTimeMs = 0;
+  // stop as soon as the most visited move can't be overtaken in the time that's left
+  bool earlyStop = true;
+  // MCTS-Solver: mark nodes where the result of the game is known as proven, stop selecting them,
+  // and stop searching once the root is proven
+  bool solver = true;
+  // keep searching on the opponents' time, from the position after our move. Ignored with
+  // limits.deterministic.
+  bool ponder = false;
+  // the most nodes a tree can hold. Only the address space is reserved up front, memory is
+  // committed as the tree grows.
+  u32 maxTreeNodes = 32 * 1024 * 1024;
+  // back the tree with transparent huge pages, where the OS supports it
+  bool hugePages = true;
+  // when reusing the tree, reorder it breadth first, so the most visited nodes are close together
+  bool breadthFirstLayout = true;
+  // log2 of the most entries in each tree's transposition table, which lets positions that are
+  // reached by different move orders share their children. 0 turns it off. The table is smaller
+  // when the search can't use that many nodes, and counts towards limits.maxMemoryBytes.
+  int transpositionTableBits = 20;
+  // number of threads searching in parallel
+  int numThreads = 1;
+  // NB: with PARALLEL_ROOT, maxTreeNodes applies to each thread's tree
+  ParallelMode parallelMode = PARALLEL_ROOT;
+  // visits added to the nodes on a thread's path until its playout is done, so threads sharing a
+  // tree spread out over different branches instead of all following the same one
+  int virtualLoss = 1;
+  // C in the UCB1 score, numWon / numPlayed + C * sqrt(ln(parent numPlayed) / numPlayed). Higher
+  // values explore more.
+  float explorationConstant = 1.41f;
+  // RAVE: blend each child's win rate with its all-moves-as-first rate, from every playout below
+  // the parent where the same player put a piece in the cell the child's move lands in. Cells are
+  // used instead of columns, as a column means something else at every height. The weight is
+  // sqrt(k / (3 * numPlayed + k)) with k = raveEquivalence, so it fades out as the child gets
+  // visits. NB: the playouts are run one after the other, like PLAYOUT_THREATS.
+  bool rave = false;
+  float raveEquivalence = 1000;
+  // A leaf's children are only created once it has been visited this many times, and until then
+  // the playouts start from the leaf itself. A visit is one simulation from the node, however many
+  // playouts batchSize runs for it. Higher values save memory, as most leaves are only
+  // visited a few times. The root is always expanded.
+  int expansionThreshold = 1;
+  // number of playouts from each new leaf (at most PlayoutBatch::MAX_LANES). With more than one,
+  // the playouts are run side by side in SIMD lanes, and backpropagated together.
+  // NB: PLAYOUT_THREATS runs them one after the other.
+  int batchSize = 1;
+  PlayoutPolicy playoutPolicy = PLAYOUT_RANDOM;
+  // Stop each playout after this many moves, and pick the winner from a static evaluation of the
+  // position, see PickLikelyWinner. 0 plays the games out.
+  int playoutDepth = 0;
+  // print stats and the move scores after each think
+  bool verbose = true;
+  // time the selection step of every iteration, for the ns/level stat. NB: this reads the clock
+  // twice per iteration, so it's off unless it's being measured.
+  bool profileSelection = false;
+};
+
+//------------------------------------------------------------------------------
+// Stats for one of the root's moves, summed over all the trees
+struct MoveStats
+{
+  int numPlayed;
+  int numWon;
+  int move;
+  // from any of the trees, as proofs don't depend on the search
+  int proof;
+};
+
+//------------------------------------------------------------------------------
+// State for one search thread. Thread i is seeded with config.seed + i.
+struct SearchWorker
+{
+  SearchWorker(NodeArena* arena, u64 seed) : arena(arena), rng(seed)
+  {
+    path.reserve(BOARD_WIDTH * BOARD_HEIGHT + 1);
+  }
+
+  // NB: nodes don't store the board. The board for a node is found by applying the moves on the
+  // path from the root, which is done on `board` when descending the tree.
+  NodeArena* arena;
+  Rng rng;
+  // working board, matching the current node while descending the tree
+  Board board;
+  // the nodes from the root to the current node. Nodes can have more than one parent, so this is
+  // what's backpropagated along.
+  vector<u32> path;
+  PlayoutBatch batch;
+  // the threat playout state for the root, and for the end of the current path. Each playout runs
+  // on a copy of the path state.
+  ThreatPlayout rootThreats;
+  ThreatPlayout pathThreats;
+  ThreatPlayout threatPlayout;
+
+  // iterations to run with SearchLimits::deterministic
+  int deterministicIterations = 0;
+
+  // stats for the last think
+  int iterations = 0;
+  // nodes that were linked to the children of a transposition instead of being expanded
+  int transpositions = 0;
+  // children created by expanding nodes
+  int nodesAllocated = 0;
+  u64 selectionLevels = 0;
+  u64 selectionNs = 0;
+
+  // the workers are allocated one after the other, so keep the hot parts of neighbouring workers
+  // off the same cache line
+  u8 padding[64];
+};
+
+//------------------------------------------------------------------------------
 struct MCTS : public AIPlayer
 {
-  MCTS(int playerId);
+  MCTS(int playerId, const MCTSConfig& config = MCTSConfig());
   ~MCTS();
   virtual void Think(GameState* state);
+  virtual void GameOver();
+  virtual bool GetThinkStatus(ThinkStatus* status);
 
-  enum 
+  enum
   {
-    MAX_TREE_NODES = 4 * 1024 * 1024,
-    NUM_BUFFER_NODES = BOARD_WIDTH*BOARD_HEIGHT,
-    TOTAL_NODES = MAX_TREE_NODES + NUM_BUFFER_NODES,
+    // room for one extra block of children past maxTreeNodes
+    NUM_BUFFER_NODES = BOARD_WIDTH,
   };
 
-  struct TreeNode
-  {
-    TreeNode* parent;
-    TreeNode* children[BOARD_WIDTH];
-    Board board;
-    int numPlayed;
-    int numWon;
-    // NB: `player` means whose turn it is to play, so the states where that player has moved are the children
-    // of the current node.
-    int player;
-  };
+  void PrepareSearch(GameState* state, int rootPlayer, const SearchLimits& limits);
+  void RunSearch();
+  void Search(SearchWorker& worker);
+  void PrepareTree(NodeArena* arena, GameState* state, int rootPlayer);
 
-  TreeNode* AddNode(TreeNode* parent, const Board& board, int player);
+  void StartPondering(GameState* state);
+  void StopPondering();
 
-  TreeNode* FindExpansionNode(GameState* state);
-  void SimulateFromNode(TreeNode* node, GameState* state);
+  u32 AddRoot(NodeArena* arena, int player);
+  u32 ExpandNode(SearchWorker& worker, u32 node, bool* linked);
+
+  u32 FindExpansionNode(SearchWorker& worker);
+  void ApplyChildMove(SearchWorker& worker, u32 child, int player, bool firstVisit);
+  bool UpdateProof(NodeArena* arena, u32 node, u32 child);
+  void SimulateFromNode(SearchWorker& worker, u32 node);
+  int Rollout(SearchWorker& worker, Board& board, int player, BitBoard* cellsPlayed);
+  void UpdateAmaf(SearchWorker& worker, BitBoard* cellsPlayed, int winner);
   int BestMove();
+  RootSummary SummarizeRoot() const;
+  int MergeRootChildren(MoveStats* moves) const;
+  int PickRandomMove(SearchWorker& worker, const Board& board);
+
+  bool CompactTree(NodeArena* arena, GameState* state);
+
+  MCTSConfig config;
+  vector<SearchWorker*> workers;
+  // one arena per worker with PARALLEL_ROOT, or a single shared one
+  vector<NodeArena*> arenas;
+  // virtual loss to use, which is 0 unless threads share the tree
+  int virtualLoss = 0;
+  // playouts run each time a node is simulated from, which is what numPlayed counts
+  int playoutsPerVisit = 1;
+
+  // limits of the current search. maxTimeMs is the hard limit, and 0 when pondering.
+  SearchLimits searchLimits;
+  u32 maxTimeMs = 0;
+  chrono::steady_clock::time_point startTime;
+  chrono::steady_clock::time_point deadline;
+  u32 maxNodes = 0;
+  int iterationsStarted = 0;
+  // set to make all the workers stop
+  u32 stopSearch = 0;
+  // true while searching on the opponents' time
+  bool pondering = false;
+  // true once the trees have been set up for the current think, so GetThinkStatus can report on
+  // them. treeMutex is held while the trees are rebuilt, and while this is changed.
+  bool thinkStarted = false;
+  mutable mutex treeMutex;
 
-  bool CompactTree(GameState* state);
-  TreeNode* CompactNode(TreeNode* node, TreeNode* parent, TreeNode* nodes);
+  TimeManager timeManager;
+  // what's left of MCTSConfig::gameTimeMs
+  u32 timeBankMs = 0;
 
-  TreeNode* nodeBufs[2];
-  int curBuf = 0;
-  int nodesUsed = 0;
+  thread ponderThread;
+
+  // board for the root node, and how many moves into the game it is
+  Board rootBoard;
+  size_t rootMoveIdx = 0;
+
+  int numPlayers = 2;
   bool doReset = false;
+
+  // results of the last think
+  int iterations = 0;
+  int transpositions = 0;
+  int nodesAllocated = 0;
+  u32 thinkMs = 0;
+  u64 selectionLevels = 0;
+  u64 selectionNs = 0;
 };
@@ -1,111 +1,314 @@
 #include "minimax.hpp"
 #include "board.hpp"
 #include "game_state.hpp"
-#if 0
 
-static unordered_map<string, int> g_BoardHash;
-static const int MAX_HASH_SIZE = 32 * 1024 * 1024;
+// a window's score for the player with 'n' pieces in it, when the opponent has none in it
+static const int WINDOW_SCORES[WIN_LENGTH + 1] = {0, 1, 4, 16, 64, 0};
+
+// the columns from the center out, which is the order moves are tried in
+static int CENTER_ORDER[BOARD_WIDTH];
 
 //------------------------------------------------------------------------------
-static int DoMiniMax(
-    const Board& oldBoard, bool maxPlayer, int minValue, int maxValue, int* bestMoveOut)
+static struct InitTables
 {
+  InitTables()
   {
+    for (int i = 0; i < BOARD_WIDTH; ++i)
+      CENTER_ORDER[i] = i;
+    stable_sort(CENTER_ORDER, CENTER_ORDER + BOARD_WIDTH, [](int lhs, int rhs) {
+      return abs(2 * lhs - (BOARD_WIDTH - 1)) < abs(2 * rhs - (BOARD_WIDTH - 1));
+    });
+  }
+} initTables;
 
-    // Check if leaf node
-    if (oldBoard.IsBoardFull())
-      return 0;
+//------------------------------------------------------------------------------
+MiniMax::MiniMax(int playerId, const MiniMaxConfig& config) : AIPlayer(playerId), config(config)
+{
+  table.Init(config.tableBits);
+}
 
-    GameState state;
-    WinningMove w = oldBoard.Winner();
-    //char player = state.winningMove.player;
-    if (w.player == PLAYER_HUMAN)
-      return 100;
-    if (w.player == PLAYER_AI)
-      return -100;
+//------------------------------------------------------------------------------
+void MiniMax::Think(GameState* state)
+{
+  AtomicStore(&statusMove, 0xffffffff);
+  if (!state->board.validMoves)
+    return;
+
+  // the scores are only zero sum with two players
+  opponentId = 0;
+  for (const Player* p : state->players.data)
+  {
+    if (p->id != playerId)
+      opponentId = p->id;
   }
 
   int bestMove = -1;
-  int bestScore = maxPlayer ? minValue : maxValue;
-  int cand;
-  if (maxPlayer)
+  if (state->players.Size() != 2)
   {
-    for (int i = 0; i < BOARD_WIDTH; ++i)
+    if (config.verbose)
+      printf("minimax needs 2 players, playing the most central move\n");
+  }
+  else
+  {
+    auto startTime = chrono::steady_clock::now();
+    deadline = startTime + chrono::milliseconds(config.maxTimeMs);
+    SetBoard(state->board);
+    aborted = false;
+    nodes = 0;
+    memset(killers, -1, sizeof(killers));
+
+    int depth = 0, score = 0;
+    int maxDepth = min(config.maxDepth, BOARD_WIDTH * BOARD_HEIGHT - board.numMoves);
+    for (int i = 1; i <= maxDepth; ++i)
+    {
+      int res = Search(i, 0, -INF_SCORE, INF_SCORE, playerId);
+      if (aborted)
+        break;
+
+      depth = i;
+      score = res;
+      bestMove = rootBestMove;
+      AtomicStore(&statusMove, (u32)bestMove);
+
+      // stop once the game is decided
+      if (abs(score) >= WIN_SCORE - MAX_PLY)
+        break;
+    }
+
+    if (config.verbose)
+    {
+      double ms = max(1.0, chrono::duration<double, milli>(
+          chrono::steady_clock::now() - startTime).count());
+      printf("minimax: depth %d, score %d, %llu nodes, %.0f nodes/s, %.0f ms\n",
+          depth,
+          score,
+          (unsigned long long)nodes,
+          nodes * 1000.0 / ms,
+          ms);
+    }
+  }
+
+  if (bestMove == -1)
+  {
+    for (int move : CENTER_ORDER)
     {
-      Board newBoard(oldBoard);
-      if (newBoard.ApplyMove(i, PLAYER_HUMAN))
+      if (state->board.ValidMove(move))
       {
-        const string& h = newBoard.ToHash();
-        auto it = g_BoardHash.find(h);
-        if (it != g_BoardHash.end())
-        {
-          cand = it->second;
-        }
-        else
-        {
-          cand = DoMiniMax(newBoard, false, bestScore, maxValue, nullptr);
-          if (g_BoardHash.size() < MAX_HASH_SIZE)
-            g_BoardHash[h] = cand;
-        }
-
-        if (cand > maxValue)
-          return maxValue;
-
-        if (cand > bestScore)
-        {
-          bestScore = cand;
-          bestMove = i;
-        }
-        if (cand == 100)
-          break;
+        bestMove = move;
+        break;
       }
     }
   }
-  else
+
+  state->board.ApplyMove(bestMove, playerId);
+  state->moves.push_back(bestMove);
+}
+
+//------------------------------------------------------------------------------
+bool MiniMax::GetThinkStatus(ThinkStatus* status)
+{
+  u32 move = AtomicLoad(&statusMove);
+  if (move == 0xffffffff)
+    return false;
+
+  *status = ThinkStatus{ (int)move, 0, 0, 0, 0, false };
+  return true;
+}
+
+//------------------------------------------------------------------------------
+bool MiniMax::OutOfTime()
+{
+  if (++nodes % CHECK_INTERVAL == 0)
   {
-    for (int i = 0; i < BOARD_WIDTH; ++i)
+    if (chrono::steady_clock::now() >= deadline || AtomicLoad(&stopThinking))
+      aborted = true;
+  }
+  return aborted;
+}
+
+//------------------------------------------------------------------------------
+int MiniMax::Search(int depth, int ply, int alpha, int beta, int player)
+{
+  // Negamax, so the score is for 'player', who is the one to move. Moves are made and unmade on
+  // the one board, and a move that wins is scored without searching any deeper.
+  if (OutOfTime())
+    return 0;
+
+  if (board.IsBoardFull())
+    return 0;
+
+  if (depth == 0)
+    return Evaluate(player);
+
+  // Win scores are stored relative to the node, as the same position can be reached at different
+  // plies
+  int tableMove = -1;
+  if (TableEntry* entry = table.Find(board.hash))
+  {
+    tableMove = entry->move;
+    if (entry->depth >= depth && ply > 0)
     {
-      Board newBoard(oldBoard);
-      if (newBoard.ApplyMove(i, PLAYER_AI))
+      int score = entry->score;
+      if (score >= WIN_SCORE - MAX_PLY)
+        score -= ply;
+      else if (score <= -WIN_SCORE + MAX_PLY)
+        score += ply;
+
+      if (entry->bound == BOUND_EXACT)
+        return score;
+      if (entry->bound == BOUND_LOWER)
+        alpha = max(alpha, score);
+      else
+        beta = min(beta, score);
+      if (alpha >= beta)
+        return score;
+    }
+  }
+
+  int moves[BOARD_WIDTH];
+  int numMoves = OrderMoves(moves, tableMove, ply);
+
+  int alphaOrig = alpha;
+  int bestScore = -INF_SCORE;
+  int bestMove = moves[0];
+  for (int i = 0; i < numMoves; ++i)
+  {
+    int move = moves[i];
+    int score;
+    if (MakeMove(move, player))
+      score = WIN_SCORE - (ply + 1);
+    else
+      score = -Search(depth - 1, ply + 1, -beta, -alpha, Opponent(player));
+    UnmakeMove(move, player);
+
+    if (aborted)
+      return 0;
+
+    if (score > bestScore)
+    {
+      bestScore = score;
+      bestMove = move;
+    }
+
+    alpha = max(alpha, score);
+    if (alpha >= beta)
+    {
+      if (killers[ply][0] != move)
       {
-        const string& h = newBoard.ToHash();
-        auto it = g_BoardHash.find(h);
-        if (it != g_BoardHash.end())
-        {
-          cand = it->second;
-        }
-        else
-        {
-          cand = DoMiniMax(newBoard, true, minValue, bestScore, nullptr);
-          if (g_BoardHash.size() < MAX_HASH_SIZE)
-            g_BoardHash[h] = cand;
-        }
-
-        if (cand < minValue)
-          return minValue;
-
-        if (cand < bestScore)
-        {
-          bestScore = cand;
-          bestMove = i;
-        }
-        if (cand == -100)
-          break;
+        killers[ply][1] = killers[ply][0];
+        killers[ply][0] = (s8)move;
       }
+      break;
     }
   }
 
-  if (bestMoveOut)
-    *bestMoveOut = bestMove;
+  if (ply == 0)
+    rootBestMove = bestMove;
+
+  // keep the deepest searches when the table is full
+  TableEntry* entry = table.Find(board.hash);
+  if (!entry || entry->depth <= depth)
+  {
+    if (!entry)
+    {
+      entry = table.InsertOrReplace(board.hash, [](const TableEntry& lhs, const TableEntry& rhs) {
+        return lhs.depth < rhs.depth;
+      });
+    }
+
+    int score = bestScore;
+    if (score >= WIN_SCORE - MAX_PLY)
+      score += ply;
+    else if (score <= -WIN_SCORE + MAX_PLY)
+      score -= ply;
+
+    entry->score = score;
+    entry->depth = (s8)min(depth, 127);
+    entry->bound = (u8)(bestScore <= alphaOrig ? BOUND_UPPER
+                                               : bestScore >= beta ? BOUND_LOWER : BOUND_EXACT);
+    entry->move = (s8)bestMove;
+  }
 
   return bestScore;
 }
 
 //------------------------------------------------------------------------------
-void MiniMax::ApplyMove(Board& board)
+int MiniMax::Evaluate(int player) const
+{
+  return player == playerId ? evalScore : -evalScore;
+}
+
+//------------------------------------------------------------------------------
+int MiniMax::WindowScore(int window) const
+{
+  // only windows that one of the players has no pieces in can still become a line
+  int own = windowPieces[0][window];
+  int other = windowPieces[1][window];
+  return (other ? 0 : WINDOW_SCORES[own]) - (own ? 0 : WINDOW_SCORES[other]);
+}
+
+//------------------------------------------------------------------------------
+void MiniMax::UpdateWindows(int bit, int player, int delta)
 {
-  int move;
-  int res = DoMiniMax(board, false, INT_MIN, INT_MAX, &move);
-  board.ApplyMove(move, PLAYER_AI);
+  // Only the windows through the cell change, so the score is updated from their old and new
+  // scores, instead of scoring the whole board at the leaves
+  u8* pieces = windowPieces[player == playerId ? 0 : 1];
+  for (int i = 0; i < CELL_NUM_WINDOWS[bit]; ++i)
+  {
+    int window = CELL_WINDOWS[bit][i];
+    evalScore -= WindowScore(window);
+    pieces[window] = (u8)(pieces[window] + delta);
+    evalScore += WindowScore(window);
+  }
+}
+
+//------------------------------------------------------------------------------
+bool MiniMax::MakeMove(int move, int player)
+{
+  UpdateWindows(move * COLUMN_STRIDE + board.heights[move], player, 1);
+  return board.ApplyMoveCheckWin(move, (char)player).won;
+}
+
+//------------------------------------------------------------------------------
+void MiniMax::UnmakeMove(int move, int player)
+{
+  board.UndoMove(move);
+  UpdateWindows(move * COLUMN_STRIDE + board.heights[move], player, -1);
+}
+
+//------------------------------------------------------------------------------
+void MiniMax::SetBoard(const Board& newBoard)
+{
+  board = newBoard;
+  memset(windowPieces, 0, sizeof(windowPieces));
+  evalScore = 0;
+  for (int bit = 0; bit < BitBoard::NUM_BITS; ++bit)
+  {
+    if (board.pieces[playerId - 1].Test(bit))
+      UpdateWindows(bit, playerId, 1);
+    else if (board.pieces[opponentId - 1].Test(bit))
+      UpdateWindows(bit, opponentId, 1);
+  }
+}
+
+//------------------------------------------------------------------------------
+int MiniMax::OrderMoves(int* moves, int tableMove, int ply) const
+{
+  int numMoves = 0;
+  u32 added = 0;
+  auto addMove = [&](int move) {
+    if (move >= 0 && board.ValidMove(move) && !(added & (1u << move)))
+    {
+      moves[numMoves++] = move;
+      added |= 1u << move;
+    }
+  };
+
+  addMove(tableMove);
+  addMove(killers[ply][0]);
+  addMove(killers[ply][1]);
+  for (int move : CENTER_ORDER)
+    addMove(move);
+
+  return numMoves;
 }
-#endif
@@ -1,12 +1,88 @@
 #pragma once
 #include "ai_player.hpp"
+#include "board.hpp"
+#include "hash_table.hpp"
+#include "line_windows.hpp"
 
-// NB: minimax is going to be broken, because I'm switching away from the 2 player requirement, and
-// the -neg/+pos scoring system (because MCTS doesn't need it)
+//------------------------------------------------------------------------------
+struct MiniMaxConfig
+{
+  // time for each move. The deepest search that finished in time is used.
+  u32 maxTimeMs = 2500;
+  int maxDepth = BOARD_WIDTH * BOARD_HEIGHT;
+  // log2 of the number of entries in the transposition table
+  int tableBits = 20;
+  // print the depth reached and the node rate after each think
+  bool verbose = true;
+};
 
-#if 0
+//------------------------------------------------------------------------------
+// Negamax search with alpha-beta pruning, for two player games. The search is iteratively deepened
+// until the time runs out, and moves are tried in the order: the best move from the transposition
+// table, the killer moves for the ply, and then the columns from the center out. Positions are
+// scored by the windows of WIN_LENGTH cells that each player can still make a line in.
 struct MiniMax : public AIPlayer
 {
-  virtual void ApplyMove(Board& board);
+  MiniMax(int playerId, const MiniMaxConfig& config = MiniMaxConfig());
+  virtual void Think(GameState* state);
+  virtual bool GetThinkStatus(ThinkStatus* status);
+
+  enum
+  {
+    // a win at ply n scores WIN_SCORE - n, so quicker wins score higher
+    WIN_SCORE = 1000000,
+    INF_SCORE = WIN_SCORE + 1,
+    MAX_PLY = BOARD_WIDTH * BOARD_HEIGHT + 1,
+    // nodes between checks of the clock
+    CHECK_INTERVAL = 4096,
+  };
+
+  enum Bound
+  {
+    BOUND_EXACT,
+    // the score is at least this
+    BOUND_LOWER,
+    // the score is at most this
+    BOUND_UPPER,
+  };
+
+  struct TableEntry
+  {
+    int score;
+    s8 depth;
+    u8 bound;
+    s8 move;
+  };
+
+  int Search(int depth, int ply, int alpha, int beta, int player);
+  int Evaluate(int player) const;
+  int WindowScore(int window) const;
+  void UpdateWindows(int bit, int player, int delta);
+  // Makes a move on the board and updates the score, and returns true if it won the game
+  bool MakeMove(int move, int player);
+  void UnmakeMove(int move, int player);
+  void SetBoard(const Board& newBoard);
+  int OrderMoves(int* moves, int tableMove, int ply) const;
+  int Opponent(int player) const { return player == playerId ? opponentId : playerId; }
+  bool OutOfTime();
+
+  MiniMaxConfig config;
+  HashTable<TableEntry> table;
+  // two killer moves for each ply, the most recent first
+  s8 killers[MAX_PLY][2];
+
+  // the board being searched, which moves are made and unmade on
+  Board board;
+  // The score is kept up to date as moves are made, from the pieces each player has in each
+  // window of WIN_LENGTH cells. Index 0 is for this player, and 1 for the opponent.
+  u8 windowPieces[2][MAX_WINDOWS];
+  int evalScore = 0;
+  int opponentId = 0;
+  chrono::steady_clock::time_point deadline;
+  bool aborted = false;
+  u64 nodes = 0;
+  int rootBestMove = -1;
+
+  // the best move of the deepest search done, for GetThinkStatus
+  u32 statusMove = 0xffffffff;
 };
-#endif
\ No newline at end of file
@@ -0,0 +1,306 @@
+#include "node_arena.hpp"
+
+// memory is committed in steps of this size, which is also the size of a huge page on x64
+static const size_t COMMIT_GRANULARITY = 2 * 1024 * 1024;
+
+//------------------------------------------------------------------------------
+static size_t RoundUp(size_t value, size_t multiple)
+{
+  return (value + multiple - 1) / multiple * multiple;
+}
+
+//------------------------------------------------------------------------------
+VirtualBuffer::~VirtualBuffer()
+{
+  Release();
+}
+
+//------------------------------------------------------------------------------
+bool VirtualBuffer::Reserve(size_t maxBytes, bool hugePages)
+{
+  Release();
+  maxBytes = RoundUp(maxBytes, COMMIT_GRANULARITY);
+
+#ifdef _WIN32
+  // NB: large pages on Windows need the lock pages privilege, and can't be committed lazily, so
+  // 'hugePages' is ignored here
+  base = (u8*)VirtualAlloc(nullptr, maxBytes, MEM_RESERVE, PAGE_NOACCESS);
+  if (!base)
+    return false;
+#else
+  void* ptr = mmap(nullptr, maxBytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (ptr == MAP_FAILED)
+    return false;
+  base = (u8*)ptr;
+#ifdef MADV_HUGEPAGE
+  // ask for transparent huge pages, to cut down on TLB misses when walking the tree
+  if (hugePages)
+    madvise(base, maxBytes, MADV_HUGEPAGE);
+#endif
+#endif
+
+  reserved = maxBytes;
+  committed = 0;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+bool VirtualBuffer::Commit(size_t bytes)
+{
+  if (bytes <= committed)
+    return true;
+
+  size_t newCommitted = min(RoundUp(bytes, COMMIT_GRANULARITY), reserved);
+  if (newCommitted < bytes)
+    return false;
+
+#ifdef _WIN32
+  if (!VirtualAlloc(base + committed, newCommitted - committed, MEM_COMMIT, PAGE_READWRITE))
+    return false;
+#else
+  if (mprotect(base + committed, newCommitted - committed, PROT_READ | PROT_WRITE) != 0)
+    return false;
+#endif
+
+  committed = newCommitted;
+  return true;
+}
+
+//------------------------------------------------------------------------------
+void VirtualBuffer::Release()
+{
+  if (!base)
+    return;
+
+#ifdef _WIN32
+  VirtualFree(base, 0, MEM_RELEASE);
+#else
+  munmap(base, reserved);
+#endif
+
+  base = nullptr;
+  reserved = 0;
+  committed = 0;
+}
+
+//------------------------------------------------------------------------------
+NodeArena::NodeArena(u32 maxNodes, bool hugePages, bool withAmaf)
+    : maxNodes(maxNodes)
+{
+  if (!nodeBuffer.Reserve(sizeof(TreeNode) * (size_t)maxNodes, hugePages)
+      || !statsBuffer.Reserve(sizeof(NodeStats) * (size_t)maxNodes, hugePages)
+      || (withAmaf && !amafBuffer.Reserve(sizeof(NodeStats) * (size_t)maxNodes, hugePages)))
+  {
+    printf("Unable to reserve memory for %u tree nodes\n", maxNodes);
+    abort();
+  }
+
+  nodes = (TreeNode*)nodeBuffer.base;
+  stats = (NodeStats*)statsBuffer.base;
+  amaf = (NodeStats*)amafBuffer.base;
+}
+
+//------------------------------------------------------------------------------
+void NodeArena::Reset()
+{
+  // Nodes are initialized when they are allocated, so there is nothing to clear, and the committed
+  // memory is kept for the next tree.
+  highWater = HighWater();
+  nodesUsed = 0;
+  table.Clear();
+}
+
+//------------------------------------------------------------------------------
+u32 NodeArena::Alloc(u32 count)
+{
+  // Bump nodesUsed with a compare exchange, so threads sharing the arena get separate blocks. The
+  // memory is committed before nodesUsed is bumped, so a failed allocation doesn't leave nodesUsed
+  // past maxNodes, or past the committed nodes.
+  u32 res = AtomicLoad(&nodesUsed);
+  while (true)
+  {
+    u32 end = res + count;
+    if (end > maxNodes)
+      return INVALID_NODE;
+    if (end > AtomicLoad(&committedNodes) && !Commit(end))
+      return INVALID_NODE;
+    if (AtomicCompareExchange(&nodesUsed, res, end))
+      return res;
+    res = AtomicLoad(&nodesUsed);
+  }
+}
+
+//------------------------------------------------------------------------------
+bool NodeArena::Commit(u32 numNodes)
+{
+  lock_guard<mutex> lock(commitMutex);
+  if (numNodes <= committedNodes)
+    return true;
+
+  if (!nodeBuffer.Commit(sizeof(TreeNode) * (size_t)numNodes)
+      || !statsBuffer.Commit(sizeof(NodeStats) * (size_t)numNodes)
+      || (amaf && !amafBuffer.Commit(sizeof(NodeStats) * (size_t)numNodes)))
+  {
+    return false;
+  }
+
+  AtomicStore(&committedNodes, (u32)min(nodeBuffer.committed / sizeof(TreeNode),
+      statsBuffer.committed / sizeof(NodeStats)));
+  return true;
+}
+
+//------------------------------------------------------------------------------
+size_t NodeArena::CommittedBytes() const
+{
+  return nodeBuffer.committed + statsBuffer.committed + amafBuffer.committed;
+}
+
+//------------------------------------------------------------------------------
+u32 NodeArena::FindChild(u32 node, int move) const
+{
+  const TreeNode& parent = nodes[node];
+  for (int i = 0; i < parent.numChildren; ++i)
+  {
+    if (nodes[parent.firstChild + i].move == move)
+      return parent.firstChild + i;
+  }
+  return INVALID_NODE;
+}
+
+//------------------------------------------------------------------------------
+void NodeArena::KeepSubtree(u32 root)
+{
+  // Find the child blocks that make up the subtree. blockStarts doubles as the queue, so this
+  // doesn't recurse, and only visits the nodes being kept. Nodes for positions that transpose
+  // share a block, so the blocks that have been found are marked in remap.
+  remap.assign(nodesUsed, INVALID_NODE);
+  remap[root] = 0;
+  blockStarts.clear();
+  auto addBlock = [this](u32 node) {
+    const TreeNode& n = nodes[node];
+    if (n.numChildren && remap[n.firstChild] == INVALID_NODE)
+    {
+      remap[n.firstChild] = 0;
+      blockStarts.push_back(n.firstChild);
+    }
+  };
+
+  addBlock(root);
+  for (size_t i = 0; i < blockStarts.size(); ++i)
+  {
+    u32 first = blockStarts[i];
+    u32 count = nodes[nodes[first].parent].numChildren;
+    for (u32 j = first; j < first + count; ++j)
+      addBlock(j);
+  }
+
+  // The blocks keep their order, so each one moves down to a lower index, and nothing is moved on
+  // top of a block that hasn't been moved yet
+  sort(blockStarts.begin(), blockStarts.end());
+  u32 used = 1;
+  for (u32 first : blockStarts)
+  {
+    u32 count = nodes[nodes[first].parent].numChildren;
+    for (u32 j = 0; j < count; ++j)
+      remap[first + j] = used + j;
+    used += count;
+  }
+
+  highWater = HighWater();
+  nodes[0] = nodes[root];
+  stats[0] = stats[root];
+  if (amaf)
+    amaf[0] = amaf[root];
+  for (size_t i = 0; i < blockStarts.size(); ++i)
+  {
+    u32 first = blockStarts[i];
+    u32 dst = remap[first];
+    u32 end = i + 1 < blockStarts.size() ? remap[blockStarts[i + 1]] : used;
+    memmove(&nodes[dst], &nodes[first], sizeof(TreeNode) * (end - dst));
+    memmove(&stats[dst], &stats[first], sizeof(NodeStats) * (end - dst));
+    if (amaf)
+      memmove(&amaf[dst], &amaf[first], sizeof(NodeStats) * (end - dst));
+  }
+
+  nodesUsed = used;
+  for (u32 i = 0; i < nodesUsed; ++i)
+  {
+    TreeNode& node = nodes[i];
+    if (node.numChildren)
+      node.firstChild = remap[node.firstChild];
+  }
+
+  // a block's parent might have been thrown away, when another node shared it
+  FixParents();
+  table.Remap(remap);
+}
+
+//------------------------------------------------------------------------------
+void NodeArena::SortBreadthFirst()
+{
+  // Find the new index of every node, by walking the child blocks breadth first. Siblings are
+  // still allocated as a block, so they stay next to each other, and a block that's shared by
+  // transposed nodes goes where it's first reached.
+  remap.assign(nodesUsed, INVALID_NODE);
+  remap[0] = 0;
+  u32 next = 1;
+  blockStarts.clear();
+  auto addBlock = [this, &next](u32 node) {
+    const TreeNode& n = nodes[node];
+    if (n.numChildren && remap[n.firstChild] == INVALID_NODE)
+    {
+      for (u32 j = 0; j < n.numChildren; ++j)
+        remap[n.firstChild + j] = next++;
+      blockStarts.push_back(n.firstChild);
+    }
+  };
+
+  addBlock(0);
+  for (size_t i = 0; i < blockStarts.size(); ++i)
+  {
+    u32 first = blockStarts[i];
+    u32 count = nodes[nodes[first].parent].numChildren;
+    for (u32 j = first; j < first + count; ++j)
+      addBlock(j);
+  }
+
+  // Patch the links to use the new indices
+  for (u32 i = 0; i < nodesUsed; ++i)
+  {
+    TreeNode& node = nodes[i];
+    if (node.parent != INVALID_NODE)
+      node.parent = remap[node.parent];
+    if (node.numChildren)
+      node.firstChild = remap[node.firstChild];
+  }
+
+  // Move the nodes in place, by following the cycles of the permutation. Each swap puts one node
+  // in its final position. remap is still needed for the table, so the swaps are done on a copy.
+  pos.assign(remap.begin(), remap.end());
+  for (u32 i = 0; i < nodesUsed; ++i)
+  {
+    while (pos[i] != i)
+    {
+      u32 j = pos[i];
+      swap(nodes[i], nodes[j]);
+      swap(stats[i], stats[j]);
+      if (amaf)
+        swap(amaf[i], amaf[j]);
+      swap(pos[i], pos[j]);
+    }
+  }
+
+  table.Remap(remap);
+}
+
+//------------------------------------------------------------------------------
+void NodeArena::FixParents()
+{
+  nodes[0].parent = INVALID_NODE;
+  for (u32 i = 0; i < nodesUsed; ++i)
+  {
+    const TreeNode& node = nodes[i];
+    for (u32 j = node.firstChild; j < node.firstChild + node.numChildren; ++j)
+      nodes[j].parent = i;
+  }
+}
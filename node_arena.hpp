@@ -0,0 +1,119 @@
+#pragma once
+#include "atomics.hpp"
+#include "transposition_table.hpp"
+
+static const u32 INVALID_NODE = 0xffffffff;
+// firstChild of a node that a thread is creating the children of
+static const u32 EXPANDING_NODE = 0xfffffffe;
+
+// TreeNode::proof of a node that hasn't been solved. Otherwise it's the id of the player who wins
+// from the node with best play, or PROOF_DRAW.
+enum
+{
+  PROOF_NONE = 0,
+  PROOF_DRAW = 0xff,
+};
+
+//------------------------------------------------------------------------------
+// The part of a node read for every child during selection. These are kept in their own array,
+// so the stats for all the children of a node are next to each other.
+struct NodeStats
+{
+  int numPlayed;
+  int numWon;
+};
+
+//------------------------------------------------------------------------------
+struct TreeNode
+{
+  // NB: nodes for positions that transpose share their children, so the children of a node don't
+  // necessarily have it as their parent. The search keeps the path it took instead.
+  u32 parent;
+  // all the children of a node are allocated as a single block when the node is expanded. When
+  // threads share the tree, numChildren is only valid after reading a firstChild that isn't
+  // INVALID_NODE or EXPANDING_NODE with AtomicLoad.
+  u32 firstChild;
+  u8 numChildren;
+  // the column played to get from the parent to this node
+  u8 move;
+  // NB: `player` means whose turn it is to play, so the states where that player has moved are the
+  // children of the current node.
+  u8 player;
+  // set by the solver once the result of the game from this node is known, see PROOF_NONE
+  u8 proof;
+  // bit i is set once child i has been proven. Proven children aren't selected again.
+  // NB: this is per node, so nodes sharing their children find out about proofs separately.
+  u32 provenChildren;
+};
+
+//------------------------------------------------------------------------------
+// Address space that is reserved up front, but only backed by memory as it's used
+struct VirtualBuffer
+{
+  ~VirtualBuffer();
+
+  bool Reserve(size_t maxBytes, bool hugePages);
+  // Makes sure at least the first 'bytes' bytes are committed
+  bool Commit(size_t bytes);
+  void Release();
+
+  u8* base = nullptr;
+  size_t reserved = 0;
+  size_t committed = 0;
+};
+
+//------------------------------------------------------------------------------
+// Storage for the nodes of a tree. Nodes are addressed by index, and the hot/cold parts of node i
+// are stats[i] and nodes[i]. Alloc can be called from several threads at once, everything else
+// has to be called while no one else is using the arena.
+struct NodeArena
+{
+  // The AMAF stats are only allocated with 'withAmaf'. NB: the transposition table starts out
+  // empty, and is sized for each search with table.Resize.
+  NodeArena(u32 maxNodes, bool hugePages, bool withAmaf);
+
+  void Reset();
+  // Allocates 'count' consecutive nodes, and returns the index of the first one, or INVALID_NODE
+  // if the arena is full. NB: the new nodes are not cleared.
+  u32 Alloc(u32 count);
+  // Commits the memory for the first 'numNodes' nodes, if it isn't already
+  bool Commit(u32 numNodes);
+  size_t CommittedBytes() const;
+  // the most nodes that have been in use at the same time
+  u32 HighWater() const { return max(highWater, nodesUsed); }
+  // Returns the child of 'node' reached by playing 'move', or INVALID_NODE
+  u32 FindChild(u32 node, int move) const;
+
+  // Makes 'root' the new root at index 0, and throws away everything outside of its subtree
+  void KeepSubtree(u32 root);
+  // Reorders the nodes in breadth first order, so the top levels of the tree, which are visited
+  // on every iteration, are packed together at the start of the arena. NB: every node has to be
+  // reachable from the root, as it is after KeepSubtree.
+  void SortBreadthFirst();
+  // Points every child block at the last of the nodes sharing it, and the root at INVALID_NODE
+  void FixParents();
+
+  VirtualBuffer nodeBuffer;
+  VirtualBuffer statsBuffer;
+  VirtualBuffer amafBuffer;
+  TreeNode* nodes = nullptr;
+  NodeStats* stats = nullptr;
+  // All-moves-as-first stats for RAVE, or nullptr. amaf[i] counts the playouts through the parent
+  // of node i where the same player later put a piece where node i's move lands.
+  NodeStats* amaf = nullptr;
+  u32 maxNodes = 0;
+  u32 committedNodes = 0;
+  u32 nodesUsed = 0;
+  // NB: only updated when nodes are thrown away, see HighWater()
+  u32 highWater = 0;
+  // held while committing more memory, which is rare enough that a lock is fine
+  mutex commitMutex;
+
+  // expanded nodes by position hash
+  TranspositionTable table;
+
+  // scratch space for KeepSubtree and SortBreadthFirst. remap[i] is the new index of node i.
+  vector<u32> blockStarts;
+  vector<u32> remap;
+  vector<u32> pos;
+};
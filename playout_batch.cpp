@@ -0,0 +1,191 @@
+#include "playout_batch.hpp"
+#include "line_windows.hpp"
+
+//------------------------------------------------------------------------------
+bool PlayoutBatch::CompletesLine(int player, int lane, int bit) const
+{
+  const u64(*words)[MAX_LANES] = pieces[player - 1];
+  auto test = [&](int cur) { return ((words[cur >> 6][lane] >> (cur & 63)) & 1) != 0; };
+
+  for (const LineDirection& dir : LINE_DIRECTIONS)
+  {
+    int shift = dir.shift;
+    // count the pieces on both sides of the cell, see Board::CompletesLine
+    int len = 1;
+    for (int cur = bit + shift; len < WIN_LENGTH && cur < BitBoard::NUM_BITS && test(cur);
+         cur += shift)
+    {
+      len++;
+    }
+
+    for (int cur = bit - shift; len < WIN_LENGTH && cur >= 0 && test(cur); cur -= shift)
+      len++;
+
+    if (len >= WIN_LENGTH)
+      return true;
+  }
+
+  return false;
+}
+
+#ifdef __AVX2__
+// boards per vector
+static const int LANE_GROUP = 4;
+
+//------------------------------------------------------------------------------
+// Shifts 4 boards n bits towards bit 0, like BitBoard::ShiftDown. n must be in [1, 63].
+static void ShiftDown4(const __m256i* x, int n, __m256i* res)
+{
+  __m128i down = _mm_cvtsi32_si128(n);
+  __m128i up = _mm_cvtsi32_si128(64 - n);
+  for (int w = 0; w < BitBoard::NUM_WORDS - 1; ++w)
+    res[w] = _mm256_or_si256(_mm256_srl_epi64(x[w], down), _mm256_sll_epi64(x[w + 1], up));
+  res[BitBoard::NUM_WORDS - 1] = _mm256_srl_epi64(x[BitBoard::NUM_WORDS - 1], down);
+}
+
+//------------------------------------------------------------------------------
+// Returns a 4 bit mask of the boards that have WIN_LENGTH pieces in a row
+static u32 FindLines4(const __m256i* x)
+{
+  static_assert(WIN_LENGTH == 5, "FindLines4 assumes 5 in a row");
+
+  __m256i any = _mm256_setzero_si256();
+  for (const LineDirection& dir : LINE_DIRECTIONS)
+  {
+    int shift = dir.shift;
+    // same doubling as Board::Winner: 2 in a row, then 4, then 5
+    __m256i pairs[BitBoard::NUM_WORDS], quads[BitBoard::NUM_WORDS], tmp[BitBoard::NUM_WORDS];
+    ShiftDown4(x, shift, tmp);
+    for (int w = 0; w < BitBoard::NUM_WORDS; ++w)
+      pairs[w] = _mm256_and_si256(x[w], tmp[w]);
+    ShiftDown4(pairs, 2 * shift, tmp);
+    for (int w = 0; w < BitBoard::NUM_WORDS; ++w)
+      quads[w] = _mm256_and_si256(pairs[w], tmp[w]);
+    ShiftDown4(x, 4 * shift, tmp);
+    for (int w = 0; w < BitBoard::NUM_WORDS; ++w)
+      any = _mm256_or_si256(any, _mm256_and_si256(quads[w], tmp[w]));
+  }
+
+  __m256i empty = _mm256_cmpeq_epi64(any, _mm256_setzero_si256());
+  return ~_mm256_movemask_pd(_mm256_castsi256_pd(empty)) & 0xf;
+}
+#else
+static const int LANE_GROUP = 1;
+#endif
+
+//------------------------------------------------------------------------------
+u32 PlayoutBatch::FindLines(int player, u32 lanes) const
+{
+  u32 res = 0;
+#ifdef __AVX2__
+  // NB: this checks the whole board, which is the same as checking the last move, as the games
+  // stop at the first line
+  const u64(*words)[MAX_LANES] = pieces[player - 1];
+  for (int group = 0; group < MAX_LANES; group += LANE_GROUP)
+  {
+    if (!((lanes >> group) & 0xf))
+      continue;
+
+    __m256i x[BitBoard::NUM_WORDS];
+    for (int w = 0; w < BitBoard::NUM_WORDS; ++w)
+      x[w] = _mm256_loadu_si256((const __m256i*)&words[w][group]);
+    res |= FindLines4(x) << group;
+  }
+#else
+  for (u32 left = lanes; left; left &= left - 1)
+  {
+    int lane = LowestBit64(left);
+    if (CompletesLine(player, lane, lastBits[lane]))
+      res |= 1u << lane;
+  }
+#endif
+  return res & lanes;
+}
+
+//------------------------------------------------------------------------------
+void PlayoutBatch::Run(const Board& board,
+    int player,
+    int numPlayers,
+    int numLanes,
+    int maxMoves,
+    Rng& rng,
+    int numWins[MAX_PLAYERS + 1])
+{
+  for (int i = 0; i <= MAX_PLAYERS; ++i)
+    numWins[i] = 0;
+
+  numLanes = max(1, min((int)MAX_LANES, numLanes));
+
+  // the move leading to the board might already have ended the game
+  int winner = board.Winner().player;
+  if (winner != NO_WINNER || board.IsBoardFull())
+  {
+    numWins[winner] = numLanes;
+    return;
+  }
+
+  // Copy the board to every lane, including the unused lanes of the last vector, so they
+  // never show up as won
+  int numBoards = (numLanes + LANE_GROUP - 1) / LANE_GROUP * LANE_GROUP;
+  for (int p = 0; p < MAX_PLAYERS; ++p)
+  {
+    for (int w = 0; w < BitBoard::NUM_WORDS; ++w)
+    {
+      for (int lane = 0; lane < numBoards; ++lane)
+        pieces[p][w][lane] = board.pieces[p].words[w];
+    }
+  }
+
+  for (int lane = 0; lane < numLanes; ++lane)
+  {
+    memcpy(heights[lane], board.heights, sizeof(board.heights));
+    validMoves[lane] = board.validMoves;
+  }
+
+  // All the games make a move on every step, so they all fill up the board at the same time.
+  // Only a win takes a game out early.
+  u32 running = numLanes == 32 ? 0xffffffff : (1u << numLanes) - 1;
+  int endMoves = BOARD_WIDTH * BOARD_HEIGHT;
+  if (maxMoves)
+    endMoves = min(endMoves, board.numMoves + maxMoves);
+  int numMoves = board.numMoves;
+  for (; running && numMoves < endMoves; ++numMoves)
+  {
+    u64(*words)[MAX_LANES] = pieces[player - 1];
+    for (u32 left = running; left; left &= left - 1)
+    {
+      int lane = LowestBit64(left);
+      u32 valid = validMoves[lane];
+      int col = NthBit64(valid, rng.Range(PopCount64(valid)));
+      int bit = col * COLUMN_STRIDE + heights[lane][col];
+      if (++heights[lane][col] == BOARD_HEIGHT)
+        validMoves[lane] &= ~(1u << col);
+      words[bit >> 6][lane] |= 1ull << (bit & 63);
+      lastBits[lane] = bit;
+    }
+
+    u32 won = FindLines(player, running);
+    numWins[player] += PopCount64(won);
+    running &= ~won;
+    player = 1 + (player % numPlayers);
+  }
+
+  if (numMoves == BOARD_WIDTH * BOARD_HEIGHT)
+  {
+    numWins[NO_WINNER] += PopCount64(running);
+    return;
+  }
+
+  // the games that were cut short
+  for (u32 left = running; left; left &= left - 1)
+  {
+    int lane = LowestBit64(left);
+    BitBoard lanePieces[MAX_PLAYERS];
+    for (int p = 0; p < MAX_PLAYERS; ++p)
+    {
+      for (int w = 0; w < BitBoard::NUM_WORDS; ++w)
+        lanePieces[p].words[w] = pieces[p][w][lane];
+    }
+    numWins[PickLikelyWinner(lanePieces, numPlayers, rng)]++;
+  }
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "board.hpp"
+#include "line_eval.hpp"
+#include "rng.hpp"
+
+//------------------------------------------------------------------------------
+// Random playouts of several games from the same position, run in lockstep. Word w of every
+// board is stored next to each other, so with AVX2 the line check for 4 boards at a time is a few
+// vector ops over the whole board. Without AVX2 each board checks the lines through its last
+// move instead, like Board::CompletesLine.
+struct PlayoutBatch
+{
+  enum
+  {
+    MAX_LANES = 32,
+  };
+
+  // Plays 'numLanes' random games from 'board', with 'player' to move. numWins[p] is set to the
+  // number of games player p won, and numWins[NO_WINNER] to the number of draws. After
+  // 'maxMoves' moves the winners of the games still going are picked with PickLikelyWinner, and
+  // 0 plays the games out.
+  void Run(const Board& board,
+      int player,
+      int numPlayers,
+      int numLanes,
+      int maxMoves,
+      Rng& rng,
+      int numWins[MAX_PLAYERS + 1]);
+
+  // Returns a mask with bit n set if the last move on board n made a line for 'player'. Only the
+  // boards in 'lanes' are checked.
+  u32 FindLines(int player, u32 lanes) const;
+  bool CompletesLine(int player, int lane, int bit) const;
+
+  // pieces[p][w][n] is word w of the pieces of player p + 1 on board n
+  u64 pieces[MAX_PLAYERS][BitBoard::NUM_WORDS][MAX_LANES];
+  u8 heights[MAX_LANES][BOARD_WIDTH];
+  u32 validMoves[MAX_LANES];
+  // the bit of the last piece played on each board
+  int lastBits[MAX_LANES];
+};
@@ -5,11 +5,20 @@
 #include <memory.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 #include <string>
 #include <unordered_map>
 #include <stdint.h>
 #include <algorithm>
 #include <deque>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 using namespace std;
 
@@ -23,5 +32,8 @@ typedef int16_t s16;
 typedef int32_t s32;
 typedef int64_t s64;
 
+#ifdef _WIN32
 #include <windows.h>
-#pragma comment(lib, "winmm.lib")
+#else
+#include <sys/mman.h>
+#endif
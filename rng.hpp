@@ -0,0 +1,41 @@
+#pragma once
+
+//------------------------------------------------------------------------------
+// xoshiro256** (http://prng.di.unimi.it/), seeded via splitmix64. Small and fast enough to give
+// each searcher its own instance, and the same seed always gives the same sequence.
+struct Rng
+{
+  Rng(u64 seed = 0) { Seed(seed); }
+
+  void Seed(u64 seed)
+  {
+    for (int i = 0; i < 4; ++i)
+    {
+      seed += 0x9e3779b97f4a7c15ull;
+      u64 z = seed;
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+      state[i] = z ^ (z >> 31);
+    }
+  }
+
+  u64 Next()
+  {
+    u64 res = Rotl(state[1] * 5, 7) * 9;
+    u64 t = state[1] << 17;
+    state[2] ^= state[0];
+    state[3] ^= state[1];
+    state[1] ^= state[2];
+    state[0] ^= state[3];
+    state[2] ^= t;
+    state[3] = Rotl(state[3], 45);
+    return res;
+  }
+
+  // Returns a value in [0, range), using a multiply instead of a modulo
+  u32 Range(u32 range) { return (u32)(((Next() >> 32) * range) >> 32); }
+
+  static u64 Rotl(u64 x, int k) { return (x << k) | (x >> (64 - k)); }
+
+  u64 state[4];
+};
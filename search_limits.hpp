@@ -0,0 +1,25 @@
+#pragma once
+
+//------------------------------------------------------------------------------
+// When a search stops. It stops at the first limit that is reached, and 0 means no limit.
+struct SearchLimits
+{
+  enum
+  {
+    // iterations run with 'deterministic' when maxIterations is 0
+    DEFAULT_DETERMINISTIC_ITERATIONS = 100000,
+  };
+
+  // wall clock time, measured on a monotonic clock
+  u32 maxTimeMs = 2500;
+  // iterations, summed over all the threads
+  int maxIterations = 0;
+  // nodes in each tree. NB: a tree can never grow past MCTSConfig::maxTreeNodes.
+  u32 maxNodes = 0;
+  // node memory, summed over all the trees
+  size_t maxMemoryBytes = 0;
+  // Ignore the clock, and run exactly maxIterations iterations, or DEFAULT_DETERMINISTIC_ITERATIONS
+  // if it's 0, so the same seed always gives the same search. With several threads this needs
+  // PARALLEL_ROOT, where each thread runs a fixed share of the iterations on its own tree.
+  bool deterministic = false;
+};
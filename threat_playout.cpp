@@ -0,0 +1,123 @@
+#include "threat_playout.hpp"
+
+//------------------------------------------------------------------------------
+void ThreatPlayout::AddPiece(int bit, int player)
+{
+  // Only the windows through the new piece change. A window that gets to WIN_LENGTH - 1 pieces of
+  // one player has a single empty cell left, which is a new threat for them.
+  // NB: the piece has to be in 'occupied' already
+  for (int i = 0; i < CELL_NUM_WINDOWS[bit]; ++i)
+  {
+    int window = CELL_WINDOWS[bit][i];
+    int state = windows[window];
+    if (state == 0)
+    {
+      windows[window] = (u8)(player * OWNER_STEP + 1);
+      continue;
+    }
+
+    if (state / OWNER_STEP != player)
+    {
+      windows[window] = DEAD_WINDOW;
+      continue;
+    }
+
+    windows[window] = (u8)++state;
+    if (state % OWNER_STEP != WIN_LENGTH - 1)
+      continue;
+
+    for (int cell : WINDOW_CELLS[window])
+    {
+      if (!occupied.Test(cell))
+        threats[player - 1].Set(cell);
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+void ThreatPlayout::Init(const Board& board)
+{
+  memset(windows, 0, sizeof(windows));
+  occupied = board.Occupied();
+  for (int p = 0; p < MAX_PLAYERS; ++p)
+  {
+    pieces[p] = board.pieces[p];
+    threats[p].Clear();
+    for (int w = 0; w < BitBoard::NUM_WORDS; ++w)
+    {
+      for (u64 bits = board.pieces[p].words[w]; bits; bits &= bits - 1)
+        AddPiece(w * 64 + LowestBit64(bits), p + 1);
+    }
+  }
+
+  memcpy(heights, board.heights, sizeof(heights));
+  validMoves = board.validMoves;
+  playable.Clear();
+  for (u32 moves = validMoves; moves; moves &= moves - 1)
+  {
+    int col = LowestBit64(moves);
+    playable.Set(col * COLUMN_STRIDE + heights[col]);
+  }
+
+  winner = board.Winner().player;
+}
+
+//------------------------------------------------------------------------------
+void ThreatPlayout::ApplyMove(int col, int player)
+{
+  int bit = col * COLUMN_STRIDE + heights[col];
+  if (threats[player - 1].Test(bit))
+    winner = player;
+
+  occupied.Set(bit);
+  pieces[player - 1].Set(bit);
+  playable.Reset(bit);
+  if (++heights[col] < BOARD_HEIGHT)
+    playable.Set(bit + 1);
+  else
+    validMoves &= ~(1u << col);
+
+  AddPiece(bit, player);
+}
+
+//------------------------------------------------------------------------------
+int ThreatPlayout::Run(int player, int numPlayers, int maxMoves, Rng& rng, BitBoard* cellsPlayed)
+{
+  // the move leading to the state might already have ended the game
+  if (winner != NO_WINNER || !validMoves)
+    return winner;
+
+  int movesLeft = maxMoves ? maxMoves : BOARD_WIDTH * BOARD_HEIGHT;
+  while (validMoves)
+  {
+    // Every cell that completes a line is a threat, so a move wins exactly when it's played on
+    // one of the player's own threats, and the other moves don't need checking
+    BitBoard wins = threats[player - 1] & playable;
+    if (wins.Any())
+    {
+      if (cellsPlayed)
+        cellsPlayed[player].Set(wins.FirstBit());
+      return player;
+    }
+
+    if (movesLeft-- == 0)
+      return PickLikelyWinner(pieces, numPlayers, rng);
+
+    BitBoard blocks;
+    for (int p = 1; p <= numPlayers; ++p)
+    {
+      if (p != player)
+        blocks |= threats[p - 1];
+    }
+    blocks &= playable;
+
+    int col = blocks.Any() ? blocks.FirstBit() / COLUMN_STRIDE
+                           : NthBit64(validMoves, rng.Range(PopCount64(validMoves)));
+    if (cellsPlayed)
+      cellsPlayed[player].Set(col * COLUMN_STRIDE + heights[col]);
+    ApplyMove(col, player);
+    player = 1 + (player % numPlayers);
+  }
+
+  return NO_WINNER;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include "board.hpp"
+#include "line_eval.hpp"
+#include "line_windows.hpp"
+#include "rng.hpp"
+
+//------------------------------------------------------------------------------
+// Playouts that play a winning move when there is one, and otherwise block a move that would win
+// for one of the other players, before falling back on a random move. The cells that would
+// complete a line for each player are kept up to date from the pieces in each window, so finding
+// the threats is a couple of bitboard ands per move. Setting up the state from a board is a lot
+// more work than a move, so it's set up once with Init, kept up to date with ApplyMove, and copied
+// for each playout.
+struct ThreatPlayout
+{
+  void Init(const Board& board);
+  // Plays 'col' for 'player'. NB: the column has to have room.
+  void ApplyMove(int col, int player);
+  // Plays a game from the current state, with 'player' to move, and returns the winner, or
+  // NO_WINNER for a draw. If 'cellsPlayed' isn't null, the cells each player played are added to
+  // cellsPlayed[player]. After 'maxMoves' moves the winner is picked with PickLikelyWinner, and 0
+  // plays the game out. NB: the moves are applied to the state.
+  int Run(int player, int numPlayers, int maxMoves, Rng& rng, BitBoard* cellsPlayed);
+
+  void AddPiece(int bit, int player);
+
+  enum
+  {
+    // A window's state is the player with pieces in it times OWNER_STEP, plus how many pieces
+    // they have. 0 is an empty window.
+    OWNER_STEP = 8,
+    // a window with pieces from more than one player, which can't become a line
+    DEAD_WINDOW = 0xff,
+  };
+
+  u8 windows[MAX_WINDOWS];
+  // the empty cells that complete a line for each player, indexed by player id - 1. NB: cells
+  // aren't removed when they are filled, so only the playable ones are looked at.
+  BitBoard threats[MAX_PLAYERS];
+  // the cell a piece dropped in each column lands in
+  BitBoard playable;
+  BitBoard occupied;
+  BitBoard pieces[MAX_PLAYERS];
+  u8 heights[BOARD_WIDTH];
+  u32 validMoves;
+  // the player that has won, or NO_WINNER
+  int winner;
+};
@@ -0,0 +1,88 @@
+#include "time_manager.hpp"
+
+//------------------------------------------------------------------------------
+enum
+{
+  // the first moves matter less, and the game is usually decided in the middle game
+  OPENING_MOVES = 8,
+  MIDDLE_GAME_MOVES = 60,
+  // most games end long before the board is full, so only this share of the empty cells are
+  // expected to be played
+  EXPECTED_FILL_PERCENT = 50,
+  MIN_MOVES_LEFT = 8,
+  // a move can be extended to this many times its target, but never past this share of the bank
+  MAX_TARGET_MULTIPLE = 3,
+  MAX_BANK_DIVISOR = 4,
+  // time between snapshots of the best move, in percent of the target
+  SNAPSHOT_PERCENT = 25,
+};
+
+// extend the search if the best move's win rate has moved more than this since the last snapshot
+static const float UNSTABLE_WIN_RATE = 0.02f;
+
+//------------------------------------------------------------------------------
+void TimeManager::StartMove(u32 moveTimeMs, u32 bankMs, const Board& board, int numPlayers)
+{
+  snapshotMove = -1;
+  snapshotWinRate = 0;
+  snapshotMs = 0;
+
+  if (!bankMs)
+  {
+    targetMs = maxMs = stopMs = moveTimeMs;
+    return;
+  }
+
+  int cellsLeft = BOARD_WIDTH * BOARD_HEIGHT - board.numMoves;
+  int movesLeft = max((int)MIN_MOVES_LEFT, cellsLeft * EXPECTED_FILL_PERCENT / 100 / numPlayers);
+
+  float phaseWeight = 1.0f;
+  if (board.numMoves < OPENING_MOVES)
+    phaseWeight = 0.5f;
+  else if (board.numMoves < MIDDLE_GAME_MOVES)
+    phaseWeight = 1.5f;
+
+  maxMs = bankMs / MAX_BANK_DIVISOR;
+  targetMs = min(maxMs, (u32)(bankMs / movesLeft * phaseWeight));
+  maxMs = min(maxMs, targetMs * MAX_TARGET_MULTIPLE);
+
+  // 0 would mean no time limit
+  targetMs = max(1u, targetMs);
+  maxMs = max(targetMs, maxMs);
+  stopMs = targetMs;
+}
+
+//------------------------------------------------------------------------------
+bool TimeManager::ShouldStop(u32 elapsedMs, const RootSummary& root, bool earlyStop)
+{
+  // is the search still changing its mind, compared to the last snapshot?
+  bool unstable = snapshotMove != -1
+      && (root.bestMove != snapshotMove
+             || fabsf(root.bestWinRate - snapshotWinRate) > UNSTABLE_WIN_RATE);
+
+  if (elapsedMs >= snapshotMs + targetMs * SNAPSHOT_PERCENT / 100)
+  {
+    snapshotMove = root.bestMove;
+    snapshotWinRate = root.bestWinRate;
+    snapshotMs = elapsedMs;
+  }
+
+  if (elapsedMs >= stopMs)
+  {
+    if (!unstable || stopMs >= maxMs)
+      return true;
+
+    stopMs = min(maxMs, stopMs + targetMs / 2);
+  }
+
+  // Stop when the runner up can't catch up with the most visited move, even if it got all the
+  // visits that are left until the planned stop
+  if (earlyStop && elapsedMs > 0)
+  {
+    double visitsLeft = (double)root.totalPlayed / elapsedMs * (stopMs - elapsedMs);
+    if (root.bestPlayed - root.secondPlayed > visitsLeft)
+      return true;
+  }
+
+  return false;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include "board.hpp"
+
+//------------------------------------------------------------------------------
+// Root stats, merged over all the trees, that the time manager looks at
+struct RootSummary
+{
+  int bestMove;
+  // visits for the most and second most visited moves
+  int bestPlayed;
+  int secondPlayed;
+  float bestWinRate;
+  // visits for the root
+  int totalPlayed;
+};
+
+//------------------------------------------------------------------------------
+// Decides how long to think for each move. Each move gets a target time, which is extended up to
+// a max time while the best move keeps changing, and the search can stop before the target when
+// the most visited move can't be overtaken anymore.
+struct TimeManager
+{
+  // Splits the time left in the game over the moves that are likely left, weighted by game phase.
+  // Without a time bank every move gets moveTimeMs.
+  void StartMove(u32 moveTimeMs, u32 bankMs, const Board& board, int numPlayers);
+  // Returns true if the search should stop after 'elapsedMs'
+  bool ShouldStop(u32 elapsedMs, const RootSummary& root, bool earlyStop);
+
+  u32 targetMs = 0;
+  u32 maxMs = 0;
+  // the target, plus any extensions
+  u32 stopMs = 0;
+
+  // the best move at the last snapshot, to see if the search has settled
+  int snapshotMove = -1;
+  float snapshotWinRate = 0;
+  u32 snapshotMs = 0;
+};
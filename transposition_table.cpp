@@ -0,0 +1,100 @@
+#include "transposition_table.hpp"
+#include "node_arena.hpp"
+
+//------------------------------------------------------------------------------
+void TranspositionTable::Init(int bits)
+{
+  numBits = bits;
+  entries.assign(numBits ? (size_t)1 << numBits : 0, Entry{ 0, INVALID_NODE });
+  mask = numBits ? (u32)(entries.size() - 1) : 0;
+  numUsed = 0;
+}
+
+//------------------------------------------------------------------------------
+void TranspositionTable::Resize(int bits)
+{
+  if (bits == numBits)
+    return;
+
+  kept.clear();
+  for (const Entry& entry : entries)
+  {
+    if (entry.node != INVALID_NODE)
+      kept.push_back(entry);
+  }
+
+  // NB: shrink_to_fit, as the old table could be a lot bigger than the new one
+  Init(bits);
+  entries.shrink_to_fit();
+  for (const Entry& entry : kept)
+    Insert(entry.hash, entry.node);
+}
+
+//------------------------------------------------------------------------------
+void TranspositionTable::Clear()
+{
+  if (numUsed == 0)
+    return;
+
+  for (Entry& entry : entries)
+    entry = Entry{ 0, INVALID_NODE };
+  numUsed = 0;
+}
+
+//------------------------------------------------------------------------------
+u32 TranspositionTable::Find(u64 hash) const
+{
+  if (entries.empty())
+    return INVALID_NODE;
+
+  for (u32 i = 0; i < MAX_PROBES; ++i)
+  {
+    const Entry& entry = entries[((u32)hash + i) & mask];
+    u32 node = AtomicLoad(&entry.node);
+    if (node == INVALID_NODE)
+      return INVALID_NODE;
+
+    // an entry that's being written is skipped, which at worst misses a transposition
+    if (node != EXPANDING_NODE && entry.hash == hash)
+      return node;
+  }
+
+  return INVALID_NODE;
+}
+
+//------------------------------------------------------------------------------
+void TranspositionTable::Insert(u64 hash, u32 node)
+{
+  if (entries.empty())
+    return;
+
+  for (u32 i = 0; i < MAX_PROBES; ++i)
+  {
+    // claim a free entry, and publish the node once the hash is written
+    Entry& entry = entries[((u32)hash + i) & mask];
+    if (AtomicCompareExchange(&entry.node, INVALID_NODE, EXPANDING_NODE))
+    {
+      entry.hash = hash;
+      AtomicStore(&entry.node, node);
+      AtomicAdd((int*)&numUsed, 1);
+      return;
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+void TranspositionTable::Remap(const vector<u32>& remap)
+{
+  // Entries can't be removed in place without breaking the probe sequences of the others, so the
+  // kept entries are inserted into a cleared table
+  kept.clear();
+  for (const Entry& entry : entries)
+  {
+    if (entry.node < remap.size() && remap[entry.node] != INVALID_NODE)
+      kept.push_back(Entry{ entry.hash, remap[entry.node] });
+  }
+
+  Clear();
+  for (const Entry& entry : kept)
+    Insert(entry.hash, entry.node);
+}
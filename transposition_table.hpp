@@ -0,0 +1,47 @@
+#pragma once
+
+//------------------------------------------------------------------------------
+// Maps position hashes to the expanded tree node for that position, so positions reached by
+// playing the same moves in a different order can share their children. Open addressing with
+// linear probing, in a fixed size table. Find and Insert can be called from several threads at
+// once, everything else has to be called while no one else is using the table.
+struct TranspositionTable
+{
+  enum
+  {
+    // entries looked at before giving up on a find or insert
+    MAX_PROBES = 16,
+    // Only expanded nodes get an entry, and there are several nodes per expanded node, so a table
+    // with one entry per this many nodes in the tree stays less than half full
+    NODES_PER_ENTRY = 2,
+  };
+
+  struct Entry
+  {
+    u64 hash;
+    // INVALID_NODE for a free entry, and EXPANDING_NODE while the hash is being written
+    u32 node;
+  };
+
+  // 'numBits' is log2 of the number of entries, and 0 disables the table
+  void Init(int numBits);
+  // Like Init, but keeps the entries that fit in the new table. Does nothing if the size is the
+  // same.
+  void Resize(int numBits);
+  void Clear();
+  // Returns the node for 'hash', or INVALID_NODE
+  u32 Find(u64 hash) const;
+  // NB: the entry is dropped if the probed entries are all in use
+  void Insert(u64 hash, u32 node);
+  // Updates the node indices after the arena has moved its nodes. remap[i] is the new index of
+  // node i, or INVALID_NODE for nodes that were thrown away.
+  void Remap(const vector<u32>& remap);
+
+  vector<Entry> entries;
+  int numBits = 0;
+  u32 mask = 0;
+  u32 numUsed = 0;
+
+  // scratch space for Remap
+  vector<Entry> kept;
+};
@@ -0,0 +1,225 @@
+#include "ucb.hpp"
+
+// visit counts below this use the lookup tables instead of calling log/sqrt
+static const int TABLE_SIZE = 4096;
+static float SQRT_LOG_TABLE[TABLE_SIZE];
+static float RSQRT_TABLE[TABLE_SIZE];
+
+//------------------------------------------------------------------------------
+static struct InitTables
+{
+  InitTables()
+  {
+    SQRT_LOG_TABLE[0] = 0;
+    RSQRT_TABLE[0] = 0;
+    for (int i = 1; i < TABLE_SIZE; ++i)
+    {
+      SQRT_LOG_TABLE[i] = sqrtf(logf((float)i));
+      RSQRT_TABLE[i] = 1 / sqrtf((float)i);
+    }
+  }
+} initTables;
+
+//------------------------------------------------------------------------------
+static float SqrtLog(int n)
+{
+  return n < TABLE_SIZE ? SQRT_LOG_TABLE[n] : sqrtf(logf((float)n));
+}
+
+//------------------------------------------------------------------------------
+static float RSqrt(int n)
+{
+  return n < TABLE_SIZE ? RSQRT_TABLE[n] : 1 / sqrtf((float)n);
+}
+
+#ifdef __AVX2__
+//------------------------------------------------------------------------------
+// Loads the stats of up to 8 children, and splits them into played/won. Children past 'count'
+// aren't read, and come back as 0.
+static void LoadStats8(const NodeStats* stats, int count, __m256* played, __m256* won)
+{
+  // the stats are {numPlayed, numWon} pairs, so 8 children are 2 vectors of 8 ints
+  __m256i lo, hi;
+  if (count >= 8)
+  {
+    lo = _mm256_loadu_si256((const __m256i*)stats);
+    hi = _mm256_loadu_si256((const __m256i*)(stats + 4));
+  }
+  else
+  {
+    __m256i idx = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i numInts = _mm256_set1_epi32(2 * count);
+    __m256i maskLo = _mm256_cmpgt_epi32(numInts, idx);
+    __m256i maskHi = _mm256_cmpgt_epi32(numInts, _mm256_add_epi32(idx, _mm256_set1_epi32(8)));
+    lo = _mm256_maskload_epi32((const int*)stats, maskLo);
+    hi = _mm256_maskload_epi32((const int*)(stats + 4), maskHi);
+  }
+
+  // lo = p0 w0 p1 w1 | p2 w2 p3 w3, hi = p4 w4 p5 w5 | p6 w6 p7 w7. The shuffles give
+  // p0 p1 p4 p5 | p2 p3 p6 p7, and the permute puts the middle 64 bit pairs back in order.
+  __m256 a = _mm256_cvtepi32_ps(lo);
+  __m256 b = _mm256_cvtepi32_ps(hi);
+  __m256 p = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+  __m256 w = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+  *played = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(p), 0xd8));
+  *won = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(w), 0xd8));
+}
+
+//------------------------------------------------------------------------------
+int SelectChildUCB1(const NodeStats* stats,
+    int numChildren,
+    int parentPlayed,
+    float c,
+    u32 skip,
+    Rng& rng,
+    bool* unvisited)
+{
+  enum
+  {
+    MAX_BLOCKS = (BOARD_WIDTH + 7) / 8
+  };
+
+  __m256 explore = _mm256_set1_ps(c * SqrtLog(parentPlayed));
+  __m256 zero = _mm256_setzero_ps();
+  __m256 minusInf = _mm256_set1_ps(-INFINITY);
+  __m256i laneBits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+  __m256 scores[MAX_BLOCKS];
+  __m256 best = minusInf;
+  u32 unvisitedMask = 0;
+  int numBlocks = (numChildren + 7) / 8;
+  for (int block = 0; block < numBlocks; ++block)
+  {
+    int first = block * 8;
+    __m256 played, won;
+    LoadStats8(stats + first, numChildren - first, &played, &won);
+
+    // rsqrt is only accurate to ~12 bits, which is plenty for the exploration term. The win rate
+    // uses a real divide, as it's compared between children with close scores.
+    __m256 score = _mm256_add_ps(
+        _mm256_div_ps(won, played), _mm256_mul_ps(explore, _mm256_rsqrt_ps(played)));
+
+    // unvisited children, skipped children, and the lanes past the last child, get -inf
+    __m256 empty = _mm256_cmp_ps(played, zero, _CMP_EQ_OQ);
+    int valid = numChildren - first >= 8 ? 0xff : (1 << (numChildren - first)) - 1;
+    valid &= ~(skip >> first);
+    unvisitedMask |= (_mm256_movemask_ps(empty) & valid) << first;
+    __m256i skipped = _mm256_cmpeq_epi32(
+        _mm256_and_si256(_mm256_set1_epi32((int)(skip >> first)), laneBits), laneBits);
+    score = _mm256_blendv_ps(score, minusInf, _mm256_or_ps(empty, _mm256_castsi256_ps(skipped)));
+
+    scores[block] = score;
+    best = _mm256_max_ps(best, score);
+  }
+
+  if (unvisitedMask)
+  {
+    *unvisited = true;
+    return NthBit64(unvisitedMask, rng.Range(PopCount64(unvisitedMask)));
+  }
+
+  // Horizontal max, and then the first child with that score. Skipped children can tie with a
+  // best score of -inf, so they are masked out.
+  __m256 t = _mm256_max_ps(best, _mm256_permute2f128_ps(best, best, 1));
+  t = _mm256_max_ps(t, _mm256_shuffle_ps(t, t, _MM_SHUFFLE(1, 0, 3, 2)));
+  t = _mm256_max_ps(t, _mm256_shuffle_ps(t, t, _MM_SHUFFLE(2, 3, 0, 1)));
+  *unvisited = false;
+  for (int block = 0; block < numBlocks; ++block)
+  {
+    int mask = _mm256_movemask_ps(_mm256_cmp_ps(scores[block], t, _CMP_EQ_OQ));
+    mask &= ~(skip >> (block * 8));
+    if (mask)
+      return block * 8 + LowestBit64(mask);
+  }
+
+  return 0;
+}
+#else
+//------------------------------------------------------------------------------
+int SelectChildUCB1(const NodeStats* stats,
+    int numChildren,
+    int parentPlayed,
+    float c,
+    u32 skip,
+    Rng& rng,
+    bool* unvisited)
+{
+  float explore = c * SqrtLog(parentPlayed);
+  float bestScore = 0;
+  int bestChild = -1;
+  u32 unvisitedMask = 0;
+  for (int i = 0; i < numChildren; ++i)
+  {
+    if (skip & (1 << i))
+      continue;
+
+    const NodeStats& s = stats[i];
+    if (!s.numPlayed)
+    {
+      unvisitedMask |= 1 << i;
+      continue;
+    }
+
+    float score = s.numWon / (float)s.numPlayed + explore * RSqrt(s.numPlayed);
+    if (score > bestScore || bestChild == -1)
+    {
+      bestChild = i;
+      bestScore = score;
+    }
+  }
+
+  *unvisited = unvisitedMask != 0;
+  if (unvisitedMask)
+    return NthBit64(unvisitedMask, rng.Range(PopCount64(unvisitedMask)));
+
+  return bestChild;
+}
+#endif
+
+//------------------------------------------------------------------------------
+int SelectChildRAVE(const NodeStats* stats,
+    const NodeStats* amaf,
+    int numChildren,
+    int parentPlayed,
+    float c,
+    float k,
+    u32 skip,
+    Rng& rng,
+    bool* unvisited)
+{
+  float explore = c * SqrtLog(parentPlayed);
+  float bestScore = 0;
+  int bestChild = -1;
+  u32 unvisitedMask = 0;
+  for (int i = 0; i < numChildren; ++i)
+  {
+    if (skip & (1 << i))
+      continue;
+
+    const NodeStats& s = stats[i];
+    const NodeStats& a = amaf[i];
+    if (!s.numPlayed && !a.numPlayed)
+    {
+      unvisitedMask |= 1 << i;
+      continue;
+    }
+
+    float winRate = s.numPlayed ? s.numWon / (float)s.numPlayed : 0;
+    float amafRate = a.numPlayed ? a.numWon / (float)a.numPlayed : winRate;
+    float beta = sqrtf(k / (3 * s.numPlayed + k));
+    float score = (1 - beta) * winRate + beta * amafRate + explore * RSqrt(max(1, s.numPlayed));
+    if (score > bestScore || bestChild == -1)
+    {
+      bestChild = i;
+      bestScore = score;
+    }
+  }
+
+  if (unvisitedMask)
+  {
+    *unvisited = true;
+    return NthBit64(unvisitedMask, rng.Range(PopCount64(unvisitedMask)));
+  }
+
+  *unvisited = stats[bestChild].numPlayed == 0;
+  return bestChild;
+}
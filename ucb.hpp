@@ -0,0 +1,33 @@
+#pragma once
+#include "board.hpp"
+#include "node_arena.hpp"
+#include "rng.hpp"
+
+//------------------------------------------------------------------------------
+// Picks the child of a node to descend into. If any children are unvisited, one of them is picked
+// at random, and 'unvisited' is set. Otherwise it's the child with the best UCB1 score,
+// numWon / numPlayed + c * sqrt(ln(parentPlayed) / numPlayed). Children with their bit set in
+// 'skip' are never picked, and at least one child has to be left. With AVX2, 8 children are
+// scored at a time.
+int SelectChildUCB1(const NodeStats* stats,
+    int numChildren,
+    int parentPlayed,
+    float c,
+    u32 skip,
+    Rng& rng,
+    bool* unvisited);
+
+//------------------------------------------------------------------------------
+// Like SelectChildUCB1, but the win rate is blended with the AMAF win rate, weighted by
+// sqrt(k / (3 * numPlayed + k)). Children without stats of either kind are picked first, and
+// children with only AMAF stats are scored on those. 'unvisited' is set if the picked child has
+// no visits.
+int SelectChildRAVE(const NodeStats* stats,
+    const NodeStats* amaf,
+    int numChildren,
+    int parentPlayed,
+    float c,
+    float k,
+    u32 skip,
+    Rng& rng,
+    bool* unvisited);